@@ -1,4 +1,7 @@
 #include "application.h"
+#include <fstream>
+#include <sstream>
+#include <glm/gtc/matrix_transform.hpp>
 #ifndef PLATFORM_EMSCRIPTEN
 #include <curl/curl.h>
 #else
@@ -11,6 +14,8 @@ using namespace skyapp;
 using DownloadedCallback = std::function<void(void*, size_t)>;
 using DownloadFailedCallback = std::function<void()>;
 
+static std::chrono::steady_clock::duration gHostBlockingTime = {}; // time spent in blocking host calls, not charged to lua
+
 SOL_BASE_CLASSES(Scene::Node, Scene::Transform);
 SOL_BASE_CLASSES(Scene::Rectangle, Scene::Node, Scene::Transform, Scene::Color);
 SOL_BASE_CLASSES(Scene::Sprite, Scene::Node, Scene::Transform, Scene::Color);
@@ -67,6 +72,7 @@ static void DownloadFileToMemory(const std::string& url, DownloadedCallback down
 	sky::Log("fetch {}", url);
 
 #ifndef PLATFORM_EMSCRIPTEN
+	auto blocking_start = std::chrono::steady_clock::now();
 	auto curl = curl_easy_init();
 
 	auto failed = [&] {
@@ -97,6 +103,8 @@ static void DownloadFileToMemory(const std::string& url, DownloadedCallback down
 	auto res = curl_easy_perform(curl);
 	curl_easy_cleanup(curl);
 
+	gHostBlockingTime += std::chrono::steady_clock::now() - blocking_start;
+
 	if (res != CURLE_OK)
 	{
 		failed();
@@ -155,8 +163,155 @@ static void DownloadFileToMemory(const std::string& url, DownloadedCallback down
 #endif
 }
 
-static skygfx::utils::Scratch gScratch;
-static bool gLuaCodeLoaded = false;
+static ThreadPool gThreadPool;
+static ThreadPool gDecodePool(1); // own thread, so busy lua workers do not hold back images
+static std::unique_ptr<TextureAtlas> gTextureAtlas; // owns gpu pages, lives with application
+static std::unique_ptr<TextureLoader> gTextureLoader;
+static std::unique_ptr<TextureCache> gTextureCache;
+
+using TextureRegionCallback = std::function<void(std::shared_ptr<TextureAtlas::Region>)>;
+
+// cached region, or decoded again from kept encoded bytes, or fetched. With atlas allowed
+// small images share atlas pages, otherwise region is whole texture. Each size is cached separately
+
+static void LoadTexture(const std::string& url, bool atlas, TextureLoader::Options options, TextureRegionCallback callback,
+	DownloadFailedCallback failedCallback = nullptr)
+{
+	auto key = atlas ? "atlas:" + url : url;
+
+	if (options.max_size.has_value())
+		key += std::format("#{}", options.max_size.value());
+
+	if (options.mipmaps)
+		key += "#mips";
+
+	if (auto region = gTextureCache->find(key))
+	{
+		callback(region);
+		return;
+	}
+
+	auto decode = [key, atlas, options, callback, failedCallback](const void* memory, size_t size) {
+		gTextureLoader->decode(memory, size, options, [key, atlas, callback](const TextureLoader::Result& result) {
+			callback(gTextureCache->insert(key, result.image, result.mips, atlas));
+		}, failedCallback);
+	};
+
+	if (auto encoded = gTextureCache->findEncoded(url))
+	{
+		decode(encoded->data(), encoded->size());
+		return;
+	}
+
+	DownloadFileToMemory(url, [url, decode](void* memory, size_t size) {
+		gTextureCache->insertEncoded(url, memory, size);
+		decode(memory, size);
+	}, failedCallback);
+}
+
+// failed host operation resolves future with nil and error, so Await returns like failed pcall
+
+static std::function<void()> MakeFailedResolver(std::weak_ptr<LuaFuture> weak_future, std::string error)
+{
+	return [weak_future, error] {
+		if (auto future = weak_future.lock())
+		{
+			future->resolve([error](lua_State* L) {
+				lua_pushnil(L);
+				lua_pushstring(L, error.c_str());
+				return 2;
+			});
+		}
+	};
+}
+
+// options are { MaxSize = pixels, Mipmaps = bool }, images are downscaled on worker
+
+static TextureLoader::Options ReadTextureOptions(const std::optional<sol::table>& options)
+{
+	auto result = TextureLoader::Options();
+
+	if (!options.has_value())
+		return result;
+
+	result.max_size = options->get<std::optional<uint32_t>>("MaxSize");
+	result.mipmaps = options->get_or("Mipmaps", false);
+	return result;
+}
+
+// rgba bytes of blob or typed array, used in place without copying
+
+static std::span<uint8_t> ReadPixels(const sol::stack_object& buffer, uint32_t width, uint32_t height)
+{
+	auto bytes = GetBufferBytes(buffer.lua_state(), buffer.stack_index());
+
+	if (!bytes.has_value())
+		throw std::runtime_error("pixels must be blob or typed array");
+
+	if (bytes->size() < (size_t)width * height * 4)
+		throw std::runtime_error("buffer is smaller than width * height * 4 bytes");
+
+	return bytes.value();
+}
+
+// textures made by Texture.FromPixels and Texture.FromEncoded, only they are owned by lua and may be written,
+// cached ones and atlas pages are shared. Held weakly, so address of released texture reused by other one is not writable
+
+static std::unordered_map<const skygfx::Texture*, std::weak_ptr<skygfx::Texture>> gWritableTextures;
+
+static std::shared_ptr<skygfx::Texture> MakeWritable(std::shared_ptr<skygfx::Texture> texture)
+{
+	std::erase_if(gWritableTextures, [](const auto& pair) {
+		return pair.second.expired();
+	});
+	gWritableTextures[texture.get()] = texture;
+	return texture;
+}
+
+static bool IsWritable(const skygfx::Texture& texture)
+{
+	auto it = gWritableTextures.find(&texture);
+	return it != gWritableTextures.end() && !it->second.expired();
+}
+
+// sprite takes only texture and rect of region, so region is held here while sprite shows it.
+// That pins region in texture cache, and sprite is moved to new page when atlas is repacked
+
+struct SpriteRegion
+{
+	std::weak_ptr<Scene::Sprite> sprite;
+	std::shared_ptr<TextureAtlas::Region> region;
+	std::shared_ptr<skygfx::Texture> texture; // given to sprite, sprite with other one was changed since
+};
+
+static std::unordered_map<const Scene::Sprite*, SpriteRegion> gSpriteRegions;
+
+static void SetSpriteRegion(std::shared_ptr<Scene::Sprite> sprite, std::shared_ptr<TextureAtlas::Region> region)
+{
+	sprite->setTexture(region->texture);
+	sprite->setTexRegion(region->tex_region);
+	gSpriteRegions[sprite.get()] = { sprite, region, region->texture };
+}
+
+static void UpdateSpriteRegions()
+{
+	std::erase_if(gSpriteRegions, [](auto& pair) {
+		auto& item = pair.second;
+		auto sprite = item.sprite.lock();
+
+		if (!sprite || sprite->getTexture() != item.texture)
+			return true;
+
+		if (item.region->texture != item.texture)
+		{
+			sprite->setTexture(item.region->texture);
+			sprite->setTexRegion(item.region->tex_region);
+			item.texture = item.region->texture;
+		}
+
+		return false;
+	});
+}
 
 static void HandleError(const sol::protected_function_result& res)
 {
@@ -166,6 +321,8 @@ static void HandleError(const sol::protected_function_result& res)
 		error_type = "SYNTAX ERROR";
 	else if (res.status() == sol::call_status::runtime)
 		error_type = "RUNTIME ERROR";
+	else if (res.status() == sol::call_status::memory)
+		error_type = "MEMORY ERROR";
 
 	auto msg = std::string(res.get<sol::error>().what());
 
@@ -182,6 +339,19 @@ static int HandlePanic(lua_State* L)
 	return 0;
 }
 
+static void BenchmarkBindings(int iterations);
+
+static std::optional<AppOptions::GCMode> ParseGCMode(const std::string& str)
+{
+	if (str == "incremental")
+		return AppOptions::GCMode::Incremental;
+
+	if (str == "generational")
+		return AppOptions::GCMode::Generational;
+
+	return std::nullopt;
+}
+
 StandardButton::StandardButton()
 {
 	setRounding(0.5f);
@@ -208,6 +378,9 @@ Application::Application() : Shared::Application(PROJECT_NAME, { Flag::Scene })
 
 	Scene::Sprite::DefaultSampler = skygfx::Sampler::Linear;
 	Scene::Sprite::DefaultTexture = TEXTURE("textures/default.png");
+	gTextureAtlas = std::make_unique<TextureAtlas>();
+	gTextureLoader = std::make_unique<TextureLoader>(gDecodePool);
+	gTextureCache = std::make_unique<TextureCache>(*gTextureAtlas);
     Scene::Label::DefaultFont = FONT("default");
 
 	// initialize lua
@@ -225,14 +398,252 @@ Application::Application() : Shared::Application(PROJECT_NAME, { Flag::Scene })
 		runApp(makeGithubUrl(user, repository, branch, filename));
 	});
 
+	CONSOLE->registerCommand("run_trusted", "run app with unchecked fast bindings", { "url" }, {}, [this](CON_ARGS) {
+		auto url = CON_ARG(0);
+		runApp(url, { .trusted = true });
+	});
+
+	CONSOLE->registerCommand("lua_bench_bindings", "compare checked and trusted bindings", {}, { "iterations" }, [](CON_ARGS) {
+		auto iterations = CON_ARGS_COUNT > 0 ? std::stoi(CON_ARG(0)) : 1000000;
+		BenchmarkBindings(iterations);
+	});
+
 	CONSOLE->registerCommand("exit", std::nullopt, {}, {}, [this](CON_ARGS) {
-		gLuaCodeLoaded = false;
+		hideApp();
+		SetUrl("");
+	});
+
+	CONSOLE->registerCommand("close", "exit and unload running app", {}, {}, [this](CON_ARGS) {
 		if (mApp)
+			closeApp(mApp);
+
+		SetUrl("");
+	});
+
+	CONSOLE->registerCommand("apps", "list resident apps", {}, {}, [this](CON_ARGS) {
+		for (const auto& resident : mResidentApps)
 		{
-			mApp->getParent()->detach(mApp);
-			mApp.reset();
+			sky::Log("{}{}: {} kb", resident.url, resident.app == mApp ? " (running)" : "",
+				resident.app->getMemoryUsage() / 1024);
 		}
-		SetUrl("");
+	});
+
+	CONSOLE->registerCommand("atlas", "texture atlas usage", {}, { "repack" }, [](CON_ARGS) {
+		if (CON_ARGS_COUNT > 0 && CON_ARG(0) == "repack")
+			gTextureAtlas->repack();
+
+		sky::Log("texture atlas: {} images in {} pages", gTextureAtlas->getImagesCount(), gTextureAtlas->getPagesCount());
+	});
+
+	CONSOLE->registerCommand("texture_upload_budget", "decoded image bytes uploaded per frame, in kilobytes", {}, { "kilobytes" }, [](CON_ARGS) {
+		if (CON_ARGS_COUNT > 0)
+			gTextureLoader->setUploadBudget(std::stoull(CON_ARG(0)) * 1024);
+
+		sky::Log("texture upload budget: {} kb, {} images pending", gTextureLoader->getUploadBudget() / 1024,
+			gTextureLoader->getPendingCount());
+	});
+
+	CONSOLE->registerCommand("texture_cache", "fetched textures memory, budget in megabytes", {}, { "megabytes" }, [](CON_ARGS) {
+		if (CON_ARGS_COUNT > 0)
+			gTextureCache->setBudget(std::stoull(CON_ARG(0)) * 1024 * 1024);
+
+		sky::Log("texture cache: {} textures, {} of {} mb, encoded {} mb", gTextureCache->getEntriesCount(),
+			gTextureCache->getBytes() / 1024 / 1024, gTextureCache->getBudget() / 1024 / 1024,
+			gTextureCache->getEncodedBytes() / 1024 / 1024);
+	});
+
+	CONSOLE->registerCommand("lua_memory_limit", "hard memory limit of running app in megabytes, 0 to disable", {}, { "megabytes" }, [this](CON_ARGS) {
+		if (!mApp)
+		{
+			sky::Log("no running app");
+			return;
+		}
+
+		if (CON_ARGS_COUNT > 0)
+		{
+			auto megabytes = std::stoull(CON_ARG(0));
+			mApp->setMemoryLimit(megabytes > 0 ? std::optional<size_t>(megabytes * 1024 * 1024) : std::nullopt);
+		}
+
+		if (auto limit = mApp->getOptions().memory_limit; limit.has_value())
+			sky::Log("lua memory limit: {} mb", limit.value() / 1024 / 1024);
+		else
+			sky::Log("lua memory limit: none");
+	});
+
+	CONSOLE->registerCommand("lua_gc_mode", "garbage collector mode of running app", {}, { "incremental|generational" }, [this](CON_ARGS) {
+		if (!mApp)
+		{
+			sky::Log("no running app");
+			return;
+		}
+
+		if (CON_ARGS_COUNT > 0)
+		{
+			auto mode = ParseGCMode(CON_ARG(0));
+			if (!mode.has_value())
+			{
+				sky::Log("unknown gc mode");
+				return;
+			}
+			mApp->setGCMode(mode.value());
+		}
+
+		sky::Log("lua gc mode: {}", magic_enum::enum_name(mApp->getOptions().gc_mode));
+	});
+
+	CONSOLE->registerCommand("lua_gc_budget", "per-frame garbage collector budget of running app in microseconds", {}, { "microseconds" }, [this](CON_ARGS) {
+		if (!mApp)
+		{
+			sky::Log("no running app");
+			return;
+		}
+
+		if (CON_ARGS_COUNT > 0)
+			mApp->setGCBudget(std::stoi(CON_ARG(0)));
+
+		sky::Log("lua gc budget: {} us", mApp->getOptions().gc_budget_us);
+	});
+
+	CONSOLE->registerCommand("lua_frame_budget", "lua execution budget of running app per frame in milliseconds", {}, { "milliseconds" }, [this](CON_ARGS) {
+		if (!mApp)
+		{
+			sky::Log("no running app");
+			return;
+		}
+
+		if (CON_ARGS_COUNT > 0)
+			mApp->setFrameBudget(std::stoi(CON_ARG(0)));
+
+		sky::Log("lua frame budget: {} ms", mApp->getOptions().frame_budget_ms);
+	});
+
+	CONSOLE->registerCommand("lua_profile", "start or stop sampling profiler of running app", {}, { "on|off|clear" }, [this](CON_ARGS) {
+		if (!mApp)
+		{
+			sky::Log("no running app");
+			return;
+		}
+
+		auto& profiler = mApp->getProfiler();
+
+		if (CON_ARGS_COUNT > 0)
+		{
+			auto arg = CON_ARG(0);
+			if (arg == "on")
+				profiler.setEnabled(true);
+			else if (arg == "off")
+				profiler.setEnabled(false);
+			else if (arg == "clear")
+				profiler.clear();
+		}
+
+		sky::Log("lua profiler: {}, {} samples", profiler.isEnabled() ? "on" : "off", profiler.getSampleCount());
+	});
+
+	CONSOLE->registerCommand("lua_heap_profile", "attribute lua allocations of running app to source lines", {}, { "on|off|clear" }, [this](CON_ARGS) {
+		if (!mApp)
+		{
+			sky::Log("no running app");
+			return;
+		}
+
+		if (CON_ARGS_COUNT > 0)
+		{
+			auto arg = CON_ARG(0);
+			if (arg == "on")
+				mApp->setHeapProfiling(true);
+			else if (arg == "off")
+				mApp->setHeapProfiling(false);
+			else if (arg == "clear")
+				mApp->getHeapProfiler().clear();
+		}
+
+		sky::Log("lua heap profiler: {}", mApp->isHeapProfiling() ? "on" : "off");
+	});
+
+	CONSOLE->registerCommand("lua_heap_snapshot", "print heap growth by source line since previous snapshot", {}, { "count" }, [this](CON_ARGS) {
+		if (!mApp)
+		{
+			sky::Log("no running app");
+			return;
+		}
+
+		if (!mApp->isHeapProfiling())
+		{
+			sky::Log("lua heap profiler is off, type lua_heap_profile on");
+			return;
+		}
+
+		auto count = CON_ARGS_COUNT > 0 ? (size_t)std::stoul(CON_ARG(0)) : (size_t)20;
+		auto prev = mApp->getHeapSnapshot();
+		mApp->takeHeapSnapshot();
+		const auto& snapshot = mApp->getHeapSnapshot().value();
+
+		if (!prev.has_value())
+		{
+			for (size_t i = 0; i < std::min(count, snapshot.locations.size()); i++)
+			{
+				const auto& stats = snapshot.locations[i];
+				sky::Log("{}: {} kb live, {} kb allocated", stats.location, stats.live_bytes / 1024, stats.allocated_bytes / 1024);
+			}
+			return;
+		}
+
+		auto seconds = std::chrono::duration<float>(snapshot.time - prev->time).count();
+		auto diff = LuaHeapProfiler::Diff(prev.value(), snapshot);
+
+		for (size_t i = 0; i < std::min(count, diff.size()); i++)
+		{
+			const auto& stats = diff[i];
+			sky::Log("{}: {:+} kb live, {:.1f} kb/s allocated", stats.location, stats.live_bytes / 1024,
+				(float)stats.allocated_bytes / 1024.0f / seconds);
+		}
+	});
+
+	CONSOLE->registerCommand("lua_profile_export", "write collapsed stacks of profiler, for flamegraph.pl or speedscope", {}, { "path" }, [this](CON_ARGS) {
+		if (!mApp)
+		{
+			sky::Log("no running app");
+			return;
+		}
+
+		auto path = CON_ARGS_COUNT > 0 ? CON_ARG(0) : "lua_profile.folded";
+		auto file = std::ofstream(path, std::ios::binary);
+
+		if (!file)
+		{
+			sky::Log(Console::Color::Red, "cannot write {}", path);
+			return;
+		}
+
+		file << mApp->getProfiler().exportCollapsedStacks();
+		sky::Log("lua profile written to {}", path);
+	});
+
+#ifdef BUILD_BINDING_STATS
+	CONSOLE->registerCommand("lua_binding_stats", "calls, time and lua allocations of bindings since start or reset", {}, { "reset" }, [](CON_ARGS) {
+		if (CON_ARGS_COUNT > 0 && CON_ARG(0) == "reset")
+		{
+			LuaBindingStats::Reset();
+			return;
+		}
+
+		for (const auto& [name, stats] : LuaBindingStats::GetSorted())
+		{
+			if (stats.total.calls == 0)
+				continue;
+
+			auto time_us = std::chrono::duration_cast<std::chrono::microseconds>(stats.total.time).count();
+			sky::Log("{}: {} calls, {} us, {} ns/call, {} allocs", name, stats.total.calls, time_us,
+				stats.total.time.count() / stats.total.calls, stats.total.allocations);
+		}
+	});
+#endif
+
+	CONSOLE->registerCommand("lua_continue", "resume app suspended by watchdog", {}, {}, [this](CON_ARGS) {
+		if (mApp)
+			mApp->resume();
 	});
 
 	CONSOLE->registerCommand("toggleconsole", std::nullopt, {}, {}, [this](CON_ARGS) {
@@ -244,6 +655,15 @@ Application::Application() : Shared::Application(PROJECT_NAME, { Flag::Scene })
 	});
 }
 
+Application::~Application()
+{
+	gTextureLoader.reset(); // pending callbacks may hold sprites
+	gSpriteRegions.clear();
+	gWritableTextures.clear();
+	gTextureCache.reset();
+	gTextureAtlas.reset(); // pages must be released before graphics device
+}
+
 static std::string MakeFinalAppEntryPointUrl(std::string url)
 {
 	if (!url.starts_with("http://") && !url.starts_with("https://"))
@@ -316,18 +736,10 @@ void Application::drawShowcaseApps()
 				auto avatar = std::make_shared<Scene::Sprite>();
 				avatar->setStretch(1.0f);
 				rect->attach(avatar);
-				if (auto url = app.avatar.value(); CACHE->hasTexture(url))
-				{
-					avatar->setTexture(TEXTURE(url));
-				}
-				else
-				{
-					DownloadFileToMemory(app.avatar.value(), [url, avatar](void* memory, size_t size) {
-						auto image = Graphics::Image(memory, size);
-						CACHE->loadTexture(image, url);
-						avatar->setTexture(TEXTURE(url));
-					});
-				}
+				// decoded to tile size, so avatars fit atlas
+				LoadTexture(app.avatar.value(), true, { .max_size = 256 }, [avatar](std::shared_ptr<TextureAtlas::Region> region) {
+					SetSpriteRegion(avatar, region);
+				});
 				auto white_fade = std::make_shared<Scene::Rectangle>();
 				white_fade->setStretch(1.0f);
 				white_fade->setColor({ Graphics::Color::White, 0.125f });
@@ -387,7 +799,7 @@ void Application::drawShowcaseApps()
 			button->setSize({ 96.0f, 32.0f });
 			button->getLabel()->setText(L"RUN");
 			button->setClickCallback([this, app] {
-				runApp(app.entry_point);
+				runApp(app.entry_point, app.options);
 				SetUrl(std::format("?+run {}", MakeFinalAppEntryPointUrl(app.entry_point)));
 			});
 			rect->attach(button);
@@ -491,6 +903,14 @@ void Application::openAppPreview(std::string url)
 		if (json.contains("avatar"))
 			app.avatar = json["avatar"];
 		app.entry_point = json["entry_point"];
+		if (json.contains("memory_limit"))
+			app.options.memory_limit = json["memory_limit"].get<size_t>() * 1024 * 1024;
+		if (json.contains("gc_mode"))
+			app.options.gc_mode = ParseGCMode(json["gc_mode"]).value_or(app.options.gc_mode);
+		if (json.contains("gc_budget_us"))
+			app.options.gc_budget_us = json["gc_budget_us"];
+		if (json.contains("frame_budget_ms"))
+			app.options.frame_budget_ms = json["frame_budget_ms"];
 		if (app.avatar)
 			app.avatar = base + app.avatar.value();
 		app.entry_point = base + app.entry_point;
@@ -498,18 +918,82 @@ void Application::openAppPreview(std::string url)
 	});
 }
 
-void Application::runApp(std::string url)
+void Application::runApp(std::string url, AppOptions options)
 {
 	url = MakeFinalAppEntryPointUrl(url);
+
+	auto find_resident = [this, url] {
+		return std::find_if(mResidentApps.begin(), mResidentApps.end(), [&](const auto& resident) {
+			return resident.url == url;
+		});
+	};
+
+	// resident app is resumed with its state, without fetching code again
+	if (auto it = find_resident(); it != mResidentApps.end())
+	{
+		showApp(it->app);
+		return;
+	}
+
 	auto base = RemoveFileNameAndExtension(url) + "/";
 
-	DownloadFileToMemory(url, [this, base](void* memory, size_t size) {
-		if (mApp)
-			mApp->getParent()->detach(mApp);
+	DownloadFileToMemory(url, [this, url, base, options, find_resident](void* memory, size_t size) {
+		if (auto it = find_resident(); it != mResidentApps.end())
+		{
+			showApp(it->app);
+			return;
+		}
+
+		auto app = std::make_shared<App>(base, options);
+		app->setLuaCode(std::string((char*)memory, size));
+		mResidentApps.push_back({ url, app });
+		showApp(app);
+
+		constexpr size_t MaxResidentApps = 4;
+
+		while (mResidentApps.size() > MaxResidentApps)
+		{
+			closeApp(mResidentApps.front().app);
+		}
+	});
+}
+
+void Application::showApp(std::shared_ptr<App> app)
+{
+	if (mApp == app)
+		return;
+
+	hideApp();
+
+	auto it = std::find_if(mResidentApps.begin(), mResidentApps.end(), [&](const auto& resident) {
+		return resident.app == app;
+	});
+
+	if (it != mResidentApps.end())
+		std::rotate(it, it + 1, mResidentApps.end()); // most recently shown goes last
+
+	mApp = app;
+	mApp->setBackground(false);
+	getScene()->getRoot()->attach(mApp);
+}
+
+void Application::hideApp()
+{
+	if (!mApp)
+		return;
+
+	mApp->getParent()->detach(mApp);
+	mApp->setBackground(true);
+	mApp.reset();
+}
+
+void Application::closeApp(std::shared_ptr<App> app)
+{
+	if (mApp == app)
+		hideApp();
 
-		mApp = std::make_shared<App>(base);
-		mApp->setLuaCode(std::string((char*)memory, size));
-		getScene()->getRoot()->attach(mApp);
+	std::erase_if(mResidentApps, [&](const auto& resident) {
+		return resident.app == app;
 	});
 }
 
@@ -521,439 +1005,2187 @@ std::string Application::makeGithubUrl(const std::string& user, const std::strin
 
 void Application::onFrame()
 {
-	if (!gLuaCodeLoaded)
+	gThreadPool.poll();
+	gDecodePool.poll();
+	gTextureLoader->update();
+	UpdateSpriteRegions();
+
+#ifdef BUILD_BINDING_STATS
+	LuaBindingStats::NextFrame();
+#endif
+
+	if (!mApp)
 	{
 		drawShowcaseApps();
 		return;
 	}
 }
 
-static void MakeApi(sol::state& lua, std::string url_base, std::shared_ptr<Scene::Node> canvas)
+// trusted profile of hot bindings, arguments are not type checked, so wrong types are undefined behaviour.
+// Semantics are the same as of checked bindings, With* builders modify self and return its copy
+
+template <auto Member>
+static int TrustedVertexWith(lua_State* L)
 {
-	auto createEnumTable = [&]<typename T>() {
-		auto table = lua.create_table();
-		for (auto value : magic_enum::enum_values<T>()) {
-			auto name = magic_enum::enum_name(value);
-			table[name] = value;
-		}
-		return table;
-	};
+	auto& vertex = sol::stack::unqualified_get<skygfx::utils::Mesh::Vertex&>(L, 1);
+	using Value = std::remove_cvref_t<decltype(vertex.*Member)>;
+	vertex.*Member = sol::stack::unqualified_get<Value&>(L, 2);
+	return sol::stack::push(L, skygfx::utils::Mesh::Vertex(vertex));
+}
 
-	lua.create_named_table("Console",
-		"Execute", [](const std::string& s) {
-			CONSOLE->execute(s);
-		},
-		"Log", [](const std::string& s, std::optional<int> _color) {
-			std::optional color = Console::Color::Default;
+static int TrustedGfxVertex(lua_State* L)
+{
+	auto scratch = static_cast<skygfx::utils::Scratch*>(lua_touserdata(L, lua_upvalueindex(1)));
+	scratch->vertex(sol::stack::unqualified_get<skygfx::utils::Mesh::Vertex&>(L, 1));
+	return 0;
+}
 
-			if (_color.has_value())
-				color = magic_enum::enum_cast<Console::Color>(_color.value());
+// checked variant, differs from trusted one only by checks, so benchmark measures their cost
+template <auto Member>
+static int VertexWith(lua_State* L)
+{
+	using Value = std::remove_cvref_t<decltype(std::declval<skygfx::utils::Mesh::Vertex&>().*Member)>;
+
+	if (!sol::stack::check<skygfx::utils::Mesh::Vertex>(L, 1, sol::no_panic))
+		return luaL_typeerror(L, 1, "Vertex");
+
+	if (!sol::stack::check<Value>(L, 2, sol::no_panic))
+		return luaL_typeerror(L, 2, "vector");
+
+	return TrustedVertexWith<Member>(L);
+}
+
+// Vertex(pos, color, texcoord, normal, tangent), omitted or nil attributes keep defaults.
+// Arguments are read up to top, sol factories would match only calls with all five
+static int NewVertex(lua_State* L)
+{
+	auto vertex = skygfx::utils::Mesh::Vertex{};
+	auto top = lua_gettop(L); // first argument is Vertex table of call constructor
+
+	auto read = [&]<typename T>(int index, T& value) {
+		if (index > top || lua_isnil(L, index))
+			return;
+
+		if (!sol::stack::check<T>(L, index, sol::no_panic))
+			luaL_typeerror(L, index, "vector");
+
+		value = sol::stack::unqualified_get<T&>(L, index);
+	};
+
+	read(2, vertex.pos);
+	read(3, vertex.color);
+	read(4, vertex.texcoord);
+	read(5, vertex.normal);
+	read(6, vertex.tangent);
+	return sol::stack::push(L, vertex);
+}
+
+// Gfx.V(x, y, [r, g, b, a], [u, v]), vertex from plain numbers without any userdata
+static int GfxV(lua_State* L)
+{
+	auto scratch = static_cast<skygfx::utils::Scratch*>(lua_touserdata(L, lua_upvalueindex(1)));
+	auto vertex = skygfx::utils::Mesh::Vertex{};
+	vertex.pos = { (float)luaL_checknumber(L, 1), (float)luaL_checknumber(L, 2), 0.0f };
+	vertex.color = { (float)luaL_optnumber(L, 3, 1.0), (float)luaL_optnumber(L, 4, 1.0), (float)luaL_optnumber(L, 5, 1.0),
+		(float)luaL_optnumber(L, 6, 1.0) };
+	vertex.texcoord = { (float)luaL_optnumber(L, 7, 0.0), (float)luaL_optnumber(L, 8, 0.0) };
+	scratch->vertex(vertex);
+	return 0;
+}
+
+// attributes of packed float vertex buffer in order, like "pos2 color4 texcoord2",
+// attributes that are not listed keep default vertex values
+
+struct VertexLayout
+{
+	struct Attribute
+	{
+		size_t offset; // in vertex, bytes
+		int count;
+	};
+
+	std::vector<Attribute> attributes;
+	size_t stride = 0; // in floats
+
+	VertexLayout(const std::string& spec)
+	{
+		using Vertex = skygfx::utils::Mesh::Vertex;
+
+		static const std::vector<std::tuple<std::string_view, size_t, int>> Known = {
+			{ "pos", offsetof(Vertex, pos), 3 },
+			{ "color", offsetof(Vertex, color), 4 },
+			{ "texcoord", offsetof(Vertex, texcoord), 2 },
+			{ "normal", offsetof(Vertex, normal), 3 },
+			{ "tangent", offsetof(Vertex, tangent), 3 }
+		};
+
+		auto stream = std::istringstream(spec);
+		auto token = std::string();
+
+		while (stream >> token)
+		{
+			auto digits = token.find_first_of("0123456789");
+			auto name = std::string_view(token).substr(0, digits);
+			auto known = std::find_if(Known.begin(), Known.end(), [&](const auto& item) {
+				return std::get<0>(item) == name;
+			});
+
+			if (known == Known.end())
+				throw std::runtime_error("unknown vertex attribute: " + token);
+
+			auto [_, offset, max_count] = *known;
+			auto count = digits == std::string::npos ? max_count : std::stoi(token.substr(digits));
+
+			if (count < 1 || count > max_count)
+				throw std::runtime_error("wrong component count: " + token);
+
+			attributes.push_back({ offset, count });
+			stride += count;
+		}
+
+		if (stride == 0)
+			throw std::runtime_error("vertex layout is empty");
+	}
+
+	template <typename F>
+	void forEach(std::span<const float> floats, F&& func) const
+	{
+		if (floats.size() % stride != 0)
+			throw std::runtime_error("buffer size is not a multiple of layout stride");
+
+		for (size_t i = 0; i < floats.size(); i += stride)
+		{
+			auto vertex = skygfx::utils::Mesh::Vertex{};
+			auto src = floats.data() + i;
+
+			for (const auto& attribute : attributes)
+			{
+				auto dst = reinterpret_cast<float*>(reinterpret_cast<uint8_t*>(&vertex) + attribute.offset);
+				std::copy_n(src, attribute.count, dst);
+				src += attribute.count;
+			}
+
+			func(vertex);
+		}
+	}
+};
+
+template <typename F>
+static void ForEachVertex(const sol::table& vertices, F&& func)
+{
+	auto L = vertices.lua_state();
+	auto size = vertices.size();
+
+	vertices.push();
+
+	for (size_t i = 1; i <= size; i++)
+	{
+		lua_rawgeti(L, -1, (lua_Integer)i);
+
+		if (!sol::stack::check<skygfx::utils::Mesh::Vertex>(L, -1, sol::no_panic))
+		{
+			lua_pop(L, 2);
+			throw std::runtime_error(std::format("element {} is not a vertex", i));
+		}
+
+		func(sol::stack::unqualified_get<skygfx::utils::Mesh::Vertex&>(L, -1));
+		lua_pop(L, 1);
+	}
+
+	lua_pop(L, 1);
+}
+
+static std::vector<skygfx::utils::Mesh::Vertex> ReadVertices(const LuaFloat32Array& buffer, const VertexLayout& layout)
+{
+	auto result = std::vector<skygfx::utils::Mesh::Vertex>();
+	layout.forEach(buffer.getSpan(), [&](const skygfx::utils::Mesh::Vertex& vertex) {
+		result.push_back(vertex);
+	});
+	return result;
+}
+
+static std::vector<skygfx::utils::Mesh::Vertex> ReadVertices(const sol::table& vertices)
+{
+	auto result = std::vector<skygfx::utils::Mesh::Vertex>();
+	ForEachVertex(vertices, [&](const skygfx::utils::Mesh::Vertex& vertex) {
+		result.push_back(vertex);
+	});
+	return result;
+}
+
+// blend mode of drawing while layer is drawn, see GfxLayer. Color is blended as usual, alpha accumulates
+// coverage with One/InvSrcAlpha, so layer holds premultiplied color with correct alpha
+
+static std::optional<skygfx::BlendMode> gLayerBlendMode;
+
+// retained geometry, uploaded once and drawn by handle. Updates go to cpu copy,
+// buffers are uploaded on draw only when changed, so many updates in a frame cost one upload
+
+class GfxMesh
+{
+public:
+	using Vertex = skygfx::utils::Mesh::Vertex;
+
+	// per instance floats: pos2, scale2, rotation, color4, uv rect4 (x, y, w, h)
+	static constexpr size_t InstanceStride = 13;
+
+	GfxMesh(skygfx::Topology topology, std::vector<Vertex> vertices, std::vector<uint32_t> indices) :
+		mTopology(topology), mVertices(std::move(vertices))
+	{
+		setIndices(std::move(indices));
+		mMesh.setTopology(topology);
+		mInstancesMesh.setTopology(topology);
+	}
+
+	// grows when range goes past the end, vertices are never removed, so indices stay valid
+	void setVertices(size_t first, const std::vector<Vertex>& vertices)
+	{
+		if (first > mVertices.size())
+			throw std::out_of_range("first vertex is past the end");
+
+		if (vertices.size() > mVertices.size() - first)
+		{
+			mVertices.resize(first + vertices.size());
+			mInstancesIndicesDirty = true;
+		}
+
+		std::copy(vertices.begin(), vertices.end(), mVertices.begin() + first);
+		mVerticesDirty = true;
+		mInstancesSourceDirty = true;
+	}
+
+	void setIndices(std::vector<uint32_t> indices)
+	{
+		for (auto index : indices)
+		{
+			if (index >= mVertices.size())
+				throw std::out_of_range(std::format("index {} is out of {} vertices", index + 1, mVertices.size()));
+		}
+
+		mIndices = std::move(indices);
+		mIndicesDirty = true;
+		mInstancesIndicesDirty = true;
+	}
+
+	void draw(skygfx::utils::Scratch& scratch, const skygfx::Texture* texture, const glm::mat4& model)
+	{
+		if (mVertices.empty())
+			return;
+
+		scratch.flush(); // keeps order with immediate drawing
+
+		if (mVerticesDirty)
+		{
+			mMesh.setVertices(mVertices);
+			mVerticesDirty = false;
+		}
+
+		if (mIndicesDirty)
+		{
+			mMesh.setIndices(mIndices);
+			mIndicesDirty = false;
+		}
+
+		execute(mMesh, !mIndices.empty(), texture, model);
+	}
+
+	// all instances in one draw call. There is no instancing in utils meshes,
+	// so copies of geometry are expanded here into one dynamic mesh. Copies are made once per geometry
+	// and count, per draw only pos, color and texcoord are transformed, see TransformInstance
+	void drawInstances(skygfx::utils::Scratch& scratch, const skygfx::Texture* texture, std::span<const float> instances)
+	{
+		if (mTopology == skygfx::Topology::LineStrip || mTopology == skygfx::Topology::TriangleStrip)
+			throw std::runtime_error("instanced mesh must have list topology");
+
+		if (instances.size() % InstanceStride != 0)
+			throw std::runtime_error("buffer size is not a multiple of instance stride");
+
+		auto count = instances.size() / InstanceStride;
+
+		if (count == 0 || mVertices.empty())
+			return;
+
+		scratch.flush();
+
+		if (mInstancesSourceDirty)
+		{
+			buildInstancesSource();
+			mInstancesVertices.clear();
+			mInstancesSourceDirty = false;
+		}
+
+		// depth, normal and tangent are not transformed, so they stay from these copies
+		if (mInstancesVertices.size() != count * mVertices.size())
+		{
+			mInstancesVertices.resize(count * mVertices.size());
+
+			for (size_t i = 0; i < count; i++)
+				std::copy(mVertices.begin(), mVertices.end(), mInstancesVertices.begin() + i * mVertices.size());
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			auto src = instances.data() + i * InstanceStride;
+			auto instance = Instance{
+				.position = { src[0], src[1] },
+				.scale = { src[2], src[3] },
+				.cos = std::cos(src[4]),
+				.sin = std::sin(src[4]),
+				.color = { src[5], src[6], src[7], src[8] },
+				.uv_origin = { src[9], src[10] },
+				.uv_size = { src[11], src[12] }
+			};
+
+			TransformInstance(mInstancesSource, mInstancesResult, instance);
+
+			auto dst = mInstancesVertices.data() + i * mVertices.size();
+
+			for (size_t j = 0; j < mVertices.size(); j++)
+			{
+				dst[j].pos.x = mInstancesResult.x[j];
+				dst[j].pos.y = mInstancesResult.y[j];
+				dst[j].color = { mInstancesResult.r[j], mInstancesResult.g[j], mInstancesResult.b[j], mInstancesResult.a[j] };
+				dst[j].texcoord = { mInstancesResult.u[j], mInstancesResult.v[j] };
+			}
+		}
+
+		mInstancesMesh.setVertices(mInstancesVertices);
+
+		// indices do not depend on instance data, so they are rebuilt only when count or geometry changes
+		if (!mIndices.empty() && (mInstancesCount != count || mInstancesIndicesDirty))
+		{
+			mInstancesIndices.resize(count * mIndices.size());
+
+			for (size_t i = 0; i < count; i++)
+			{
+				auto base = (uint32_t)(i * mVertices.size());
+				auto dst = mInstancesIndices.data() + i * mIndices.size();
+
+				for (size_t j = 0; j < mIndices.size(); j++)
+					dst[j] = base + mIndices[j];
+			}
+
+			mInstancesMesh.setIndices(mInstancesIndices);
+			mInstancesCount = count;
+			mInstancesIndicesDirty = false;
+		}
+
+		execute(mInstancesMesh, !mIndices.empty(), texture, glm::mat4(1.0f));
+	}
+
+	auto getVertexCount() const { return mVertices.size(); }
+	auto getIndexCount() const { return mIndices.size(); }
+
+private:
+	// transformed vertex attributes split by component, so one instance is transformed by plain float arrays
+	struct Components
+	{
+		std::vector<float> x, y, r, g, b, a, u, v;
+	};
+
+	struct Instance
+	{
+		glm::vec2 position;
+		glm::vec2 scale;
+		float cos;
+		float sin;
+		glm::vec4 color;
+		glm::vec2 uv_origin;
+		glm::vec2 uv_size;
+	};
+
+	// arrays are padded to whole lanes, vertices are processed four at a time by fixed inner loop,
+	// which compilers turn into simd instructions at usual optimization levels, without intrinsics per platform
+	static constexpr size_t Lanes = 4;
+
+	void buildInstancesSource()
+	{
+		auto size = (mVertices.size() + Lanes - 1) / Lanes * Lanes;
+
+		for (auto components : { &mInstancesSource, &mInstancesResult })
+		{
+			for (auto array : { &components->x, &components->y, &components->r, &components->g, &components->b,
+				&components->a, &components->u, &components->v })
+			{
+				array->assign(size, 0.0f);
+			}
+		}
+
+		for (size_t j = 0; j < mVertices.size(); j++)
+		{
+			const auto& vertex = mVertices[j];
+			mInstancesSource.x[j] = vertex.pos.x;
+			mInstancesSource.y[j] = vertex.pos.y;
+			mInstancesSource.r[j] = vertex.color.r;
+			mInstancesSource.g[j] = vertex.color.g;
+			mInstancesSource.b[j] = vertex.color.b;
+			mInstancesSource.a[j] = vertex.color.a;
+			mInstancesSource.u[j] = vertex.texcoord.x;
+			mInstancesSource.v[j] = vertex.texcoord.y;
+		}
+	}
+
+	static void TransformInstance(const Components& src, Components& dst, const Instance& instance)
+	{
+		TransformInstance(src.x.size(), src.x.data(), src.y.data(), src.r.data(), src.g.data(), src.b.data(),
+			src.a.data(), src.u.data(), src.v.data(), dst.x.data(), dst.y.data(), dst.r.data(), dst.g.data(),
+			dst.b.data(), dst.a.data(), dst.u.data(), dst.v.data(), instance);
+	}
+
+	// restrict qualified parameters and instance copy, so compiler knows stores do not change inputs
+	static void TransformInstance(size_t size, const float* __restrict sx, const float* __restrict sy,
+		const float* __restrict sr, const float* __restrict sg, const float* __restrict sb, const float* __restrict sa,
+		const float* __restrict su, const float* __restrict sv, float* __restrict dx, float* __restrict dy,
+		float* __restrict dr, float* __restrict dg, float* __restrict db, float* __restrict da, float* __restrict du,
+		float* __restrict dv, Instance instance)
+	{
+		for (size_t j = 0; j < size; j += Lanes)
+		{
+			for (size_t k = 0; k < Lanes; k++)
+			{
+				auto x = sx[j + k] * instance.scale.x;
+				auto y = sy[j + k] * instance.scale.y;
+				dx[j + k] = instance.position.x + x * instance.cos - y * instance.sin;
+				dy[j + k] = instance.position.y + x * instance.sin + y * instance.cos;
+				dr[j + k] = sr[j + k] * instance.color.r;
+				dg[j + k] = sg[j + k] * instance.color.g;
+				db[j + k] = sb[j + k] * instance.color.b;
+				da[j + k] = sa[j + k] * instance.color.a;
+				du[j + k] = instance.uv_origin.x + su[j + k] * instance.uv_size.x;
+				dv[j + k] = instance.uv_origin.y + sv[j + k] * instance.uv_size.y;
+			}
+		}
+	}
+
+	static void execute(skygfx::utils::Mesh& mesh, bool indexed, const skygfx::Texture* texture, const glm::mat4& model)
+	{
+		auto draw_command = indexed ? skygfx::utils::DrawCommand(skygfx::utils::DrawIndexedVerticesCommand{}) :
+			skygfx::utils::DrawCommand(skygfx::utils::DrawVerticesCommand{});
+
+		skygfx::utils::ExecuteCommands({
+			skygfx::utils::commands::SetBlendMode(gLayerBlendMode), // nullopt keeps default
+			skygfx::utils::commands::SetMesh(&mesh),
+			skygfx::utils::commands::SetColorTexture(texture),
+			skygfx::utils::commands::SetModelMatrix(model),
+			skygfx::utils::commands::Draw(draw_command)
+		});
+	}
+
+private:
+	skygfx::Topology mTopology;
+	skygfx::utils::Mesh mMesh;
+	std::vector<Vertex> mVertices;
+	std::vector<uint32_t> mIndices;
+	bool mVerticesDirty = true;
+	bool mIndicesDirty = true;
+	skygfx::utils::Mesh mInstancesMesh;
+	std::vector<Vertex> mInstancesVertices;
+	std::vector<uint32_t> mInstancesIndices;
+	size_t mInstancesCount = 0;
+	bool mInstancesIndicesDirty = true;
+	Components mInstancesSource;
+	Components mInstancesResult;
+	bool mInstancesSourceDirty = true;
+};
+
+// offscreen copy of static drawing, lua redraws it only when dirty and it is composited as one quad.
+// Layer has backbuffer size, so drawing into it looks the same as drawing on screen, resize makes it dirty.
+// Drawing into layer uses gLayerBlendMode, so semi transparent content is composited like it was drawn directly
+
+class GfxLayer
+{
+public:
+	GfxLayer()
+	{
+		using Vertex = skygfx::utils::Mesh::Vertex;
+
+		auto white = glm::vec4{ 1.0f, 1.0f, 1.0f, 1.0f };
+		auto vertices = std::vector<Vertex>(4);
+		vertices[0].pos = { -1.0f, 1.0f, 0.0f };
+		vertices[0].texcoord = { 0.0f, 0.0f };
+		vertices[1].pos = { 1.0f, 1.0f, 0.0f };
+		vertices[1].texcoord = { 1.0f, 0.0f };
+		vertices[2].pos = { 1.0f, -1.0f, 0.0f };
+		vertices[2].texcoord = { 1.0f, 1.0f };
+		vertices[3].pos = { -1.0f, -1.0f, 0.0f };
+		vertices[3].texcoord = { 0.0f, 1.0f };
+
+		for (auto& vertex : vertices)
+			vertex.color = white;
+
+		mQuad.setTopology(skygfx::Topology::TriangleList);
+		mQuad.setVertices(vertices);
+		mQuad.setIndices({ 0, 1, 2, 0, 2, 3 });
+	}
+
+	~GfxLayer()
+	{
+		if (Active == this)
+			Recover();
+	}
+
+	bool isDirty() const
+	{
+		return mDirty || !mTarget || mTarget->getWidth() != skygfx::GetBackbufferWidth() ||
+			mTarget->getHeight() != skygfx::GetBackbufferHeight();
+	}
+
+	void invalidate() { mDirty = true; }
+
+	void begin(skygfx::utils::Scratch& scratch)
+	{
+		if (Active != nullptr)
+			throw std::runtime_error("another layer is being drawn");
+
+		if (scratch.isBegan())
+			throw std::runtime_error("layer cannot begin inside Gfx.Begin");
+
+		auto width = skygfx::GetBackbufferWidth();
+		auto height = skygfx::GetBackbufferHeight();
+
+		if (!mTarget || mTarget->getWidth() != width || mTarget->getHeight() != height)
+			mTarget = std::make_shared<skygfx::RenderTarget>(width, height, skygfx::PixelFormat::RGBA8UNorm);
+
+		scratch.flush();
+		PreviousTargets = skygfx::GetRenderTarget();
+		skygfx::SetRenderTarget(*mTarget);
+		skygfx::Clear(glm::vec4{ 0.0f, 0.0f, 0.0f, 0.0f });
+		gLayerBlendMode = skygfx::BlendMode(skygfx::Blend::SrcAlpha, skygfx::Blend::InvSrcAlpha,
+			skygfx::Blend::One, skygfx::Blend::InvSrcAlpha);
+		Active = this;
+	}
+
+	void end(skygfx::utils::Scratch& scratch)
+	{
+		if (Active != this)
+			throw std::runtime_error("layer is not being drawn");
+
+		scratch.flush();
+		Recover();
+		mDirty = false;
+	}
+
+	void draw(skygfx::utils::Scratch& scratch)
+	{
+		if (!mTarget || Active == this)
+			return;
+
+		scratch.flush();
+
+		// layer was cleared to transparent, so drawing into it leaves color already multiplied by alpha,
+		// straight alpha blending would apply alpha once more
+		skygfx::utils::ExecuteCommands({
+			skygfx::utils::commands::SetBlendMode(skygfx::BlendStates::AlphaBlend), // premultiplied
+			skygfx::utils::commands::SetMesh(&mQuad),
+			skygfx::utils::commands::SetColorTexture(mTarget.get()),
+			skygfx::utils::commands::SetProjectionMatrix(glm::mat4(1.0f)),
+			skygfx::utils::commands::SetViewMatrix(glm::mat4(1.0f)),
+			skygfx::utils::commands::Draw(skygfx::utils::DrawIndexedVerticesCommand{})
+		});
+	}
+
+	std::shared_ptr<skygfx::Texture> getTexture() const { return mTarget; }
+
+	// target bound before layer is restored when lua failed or forgot to end layer, layer stays dirty.
+	// Called after every frame of app, and when app is suspended, moved to background or closed
+	static void Recover()
+	{
+		if (Active == nullptr)
+			return;
+
+		if (PreviousTargets.empty())
+			skygfx::SetRenderTarget(std::nullopt);
+		else
+			skygfx::SetRenderTarget(PreviousTargets);
+
+		PreviousTargets.clear();
+		gLayerBlendMode.reset();
+		Active = nullptr;
+	}
+
+private:
+	static inline GfxLayer* Active = nullptr;
+	static inline std::vector<const skygfx::RenderTarget*> PreviousTargets; // empty for screen
+	std::shared_ptr<skygfx::RenderTarget> mTarget;
+	skygfx::utils::Mesh mQuad;
+	bool mDirty = true;
+};
+
+// lua indices are 1-based, upper bound is checked by mesh against its vertex count
+static std::vector<uint32_t> ReadIndices(const std::optional<sol::object>& indices)
+{
+	auto result = std::vector<uint32_t>();
+
+	if (!indices.has_value() || indices->get_type() == sol::type::lua_nil)
+		return result;
+
+	auto add = [&](lua_Integer index) {
+		if (index < 1 || index > (lua_Integer)std::numeric_limits<uint32_t>::max())
+			throw std::out_of_range(std::format("index {} is out of range", index));
+
+		result.push_back((uint32_t)(index - 1));
+	};
+
+	if (indices->is<LuaInt32Array>())
+	{
+		for (auto index : indices->as<const LuaInt32Array&>().getSpan())
+			add(index);
+	}
+	else if (indices->is<sol::table>())
+	{
+		auto table = indices->as<sol::table>();
+		for (size_t i = 1; i <= table.size(); i++)
+			add(table.raw_get<lua_Integer>(i));
+	}
+	else
+	{
+		throw std::runtime_error("indices must be Int32Array or table");
+	}
+
+	return result;
+}
+
+static size_t ToVertexOffset(lua_Integer first)
+{
+	if (first < 1)
+		throw std::out_of_range("first vertex index must be at least 1");
+
+	return (size_t)(first - 1);
+}
+
+static glm::mat4 MakeModelMatrix(std::optional<glm::vec2> position, std::optional<glm::vec2> scale, std::optional<float> rotation)
+{
+	auto model = glm::translate(glm::mat4(1.0f), glm::vec3(position.value_or(glm::vec2(0.0f)), 0.0f));
+	model = glm::rotate(model, rotation.value_or(0.0f), { 0.0f, 0.0f, 1.0f });
+	return glm::scale(model, glm::vec3(scale.value_or(glm::vec2(1.0f)), 1.0f));
+}
+
+// label text crosses lua boundary as utf-8 through reused buffers,
+// identical text is detected before conversion, so unchanged hud values cost no allocation or relayout
+
+static std::string_view GetLabelText(const Scene::Label& label)
+{
+	static std::string buffer;
+	WideToUtf8(label.getText(), buffer);
+	return buffer;
+}
+
+static void SetLabelText(Scene::Label& label, std::string_view text)
+{
+	if (EqualsUtf8(label.getText(), text))
+		return;
+
+	static std::wstring buffer;
+	Utf8ToWide(text, buffer);
+	label.setText(buffer);
+}
+
+// vector methods are plain c functions, otherwise sol allocates a closure on every method lookup
+// of usertypes that have fields. Operators and plain methods return new vectors (userdata each),
+// *InPlace methods modify self and allocate nothing, hot loops should keep temporaries and use them.
+// Operator results are not pooled: their blocks already come from size-class pools of LuaAllocator,
+// returning them to a pool would need __gc on every vector, which costs collector more than plain garbage,
+// and reused result objects would alias vectors kept by lua code
+
+template <auto... Funcs>
+static constexpr lua_CFunction CFunction = &sol::c_call<sol::wrap<decltype(Funcs), Funcs>...>;
+
+template <typename T>
+struct VectorApi
+{
+	static T Add(const T& a, const T& b) { return a + b; }
+	static T Sub(const T& a, const T& b) { return a - b; }
+	static T Mul(const T& a, const T& b) { return a * b; }
+	static T MulScalar(const T& a, float b) { return a * b; }
+	static T ScalarMul(float a, const T& b) { return a * b; }
+	static T Div(const T& a, const T& b) { return a / b; }
+	static T DivScalar(const T& a, float b) { return a / b; }
+	static T Negate(const T& a) { return -a; }
+	static bool Equal(const T& a, const T& b) { return a == b; }
+
+	static std::string ToString(const T& a)
+	{
+		auto result = std::format("Vec{}(", T::length());
+		for (int i = 0; i < T::length(); i++)
+			result += (i == 0 ? "" : ", ") + std::format("{}", a[i]);
+		return result + ")";
+	}
+
+	static float Length(const T& self) { return glm::length(self); }
+	static float LengthSquared(const T& self) { return glm::dot(self, self); }
+	static float Distance(const T& self, const T& other) { return glm::distance(self, other); }
+	static float Dot(const T& self, const T& other) { return glm::dot(self, other); }
+	static T Lerp(const T& self, const T& other, float t) { return glm::mix(self, other, t); }
+
+	static T Normalize(const T& self)
+	{
+		auto length = glm::length(self);
+		return length > 0.0f ? self / length : T(0.0f);
+	}
+
+	static void CopyFrom(T& self, const T& other) { self = other; }
+	static void AddInPlace(T& self, const T& other) { self += other; }
+	static void SubInPlace(T& self, const T& other) { self -= other; }
+	static void MulInPlace(T& self, const T& other) { self *= other; }
+	static void MulScalarInPlace(T& self, float value) { self *= value; }
+	static void DivInPlace(T& self, const T& other) { self /= other; }
+	static void DivScalarInPlace(T& self, float value) { self /= value; }
+	static void AddScaledInPlace(T& self, const T& other, float scale) { self += other * scale; } // position:AddScaledInPlace(velocity, dt)
+	static void NormalizeInPlace(T& self) { self = Normalize(self); }
+	static void LerpInPlace(T& self, const T& other, float t) { self = glm::mix(self, other, t); }
+};
+
+static void SetVec2(glm::vec2& self, float x, float y) { self = { x, y }; }
+static void SetVec3(glm::vec3& self, float x, float y, float z) { self = { x, y, z }; }
+static void SetVec4(glm::vec4& self, float x, float y, float z, float w) { self = { x, y, z, w }; }
+static glm::vec3 CrossVec3(const glm::vec3& self, const glm::vec3& other) { return glm::cross(self, other); }
+
+template <typename T, typename... Fields>
+static void MakeVectorType(sol::state& lua, const std::string& name, Fields&&... fields)
+{
+	using Api = VectorApi<T>;
+
+	lua.new_usertype<T>(name, std::forward<Fields>(fields)...,
+		sol::meta_function::addition, BindCFunction<CFunction<&Api::Add>>(name + ".__add"),
+		sol::meta_function::subtraction, BindCFunction<CFunction<&Api::Sub>>(name + ".__sub"),
+		sol::meta_function::multiplication, BindCFunction<CFunction<&Api::Mul, &Api::MulScalar, &Api::ScalarMul>>(name + ".__mul"),
+		sol::meta_function::division, BindCFunction<CFunction<&Api::Div, &Api::DivScalar>>(name + ".__div"),
+		sol::meta_function::unary_minus, BindCFunction<CFunction<&Api::Negate>>(name + ".__unm"),
+		sol::meta_function::equal_to, BindCFunction<CFunction<&Api::Equal>>(name + ".__eq"),
+		sol::meta_function::to_string, BindCFunction<CFunction<&Api::ToString>>(name + ".__tostring"),
+		"Length", BindCFunction<CFunction<&Api::Length>>(name + ".Length"),
+		"LengthSquared", BindCFunction<CFunction<&Api::LengthSquared>>(name + ".LengthSquared"),
+		"Distance", BindCFunction<CFunction<&Api::Distance>>(name + ".Distance"),
+		"Dot", BindCFunction<CFunction<&Api::Dot>>(name + ".Dot"),
+		"Normalize", BindCFunction<CFunction<&Api::Normalize>>(name + ".Normalize"),
+		"Lerp", BindCFunction<CFunction<&Api::Lerp>>(name + ".Lerp"),
+		"CopyFrom", BindCFunction<CFunction<&Api::CopyFrom>>(name + ".CopyFrom"),
+		"AddInPlace", BindCFunction<CFunction<&Api::AddInPlace>>(name + ".AddInPlace"),
+		"SubInPlace", BindCFunction<CFunction<&Api::SubInPlace>>(name + ".SubInPlace"),
+		"MulInPlace", BindCFunction<CFunction<&Api::MulInPlace, &Api::MulScalarInPlace>>(name + ".MulInPlace"),
+		"DivInPlace", BindCFunction<CFunction<&Api::DivInPlace, &Api::DivScalarInPlace>>(name + ".DivInPlace"),
+		"AddScaledInPlace", BindCFunction<CFunction<&Api::AddScaledInPlace>>(name + ".AddScaledInPlace"),
+		"NormalizeInPlace", BindCFunction<CFunction<&Api::NormalizeInPlace>>(name + ".NormalizeInPlace"),
+		"LerpInPlace", BindCFunction<CFunction<&Api::LerpInPlace>>(name + ".LerpInPlace")
+	);
+}
+
+static void MakeApi(sol::state& lua, std::string url_base, std::shared_ptr<Scene::Node> canvas, LuaScheduler& scheduler,
+	skygfx::utils::Scratch& scratch, bool trusted)
+{
+	auto createEnumTable = [&]<typename T>() {
+		auto table = lua.create_table();
+		for (auto value : magic_enum::enum_values<T>()) {
+			auto name = magic_enum::enum_name(value);
+			table[name] = value;
+		}
+		return table;
+	};
+
+	lua.create_named_table("Console",
+		"Execute", Bind("Console.Execute", [](const std::string& s) {
+			CONSOLE->execute(s);
+		}),
+		"Log", Bind("Console.Log", [](const std::string& s, std::optional<int> _color) {
+			std::optional color = Console::Color::Default;
+
+			if (_color.has_value())
+				color = magic_enum::enum_cast<Console::Color>(_color.value());
 
 			CONSOLE_DEVICE->write("[lua] ", Console::Color::Yellow);
 			sky::Log(color.value(), s);
-		},
+		}),
 		"Color", createEnumTable.template operator()<Console::Color>()
 	);
 
-	lua.new_usertype<skygfx::utils::Mesh::Vertex>("Vertex",
-		sol::call_constructor, sol::constructors<skygfx::utils::Mesh::Vertex()>(),
-		"WithPos", [](skygfx::utils::Mesh::Vertex& vertex, const glm::vec3& pos) {
-			vertex.pos = pos;
-			return vertex;
-		},
-		"WithColor", [](skygfx::utils::Mesh::Vertex& vertex, const glm::vec4& color) {
-			vertex.color = color;
-			return vertex;
-		},
-		"WithTexCoord", [](skygfx::utils::Mesh::Vertex& vertex, const glm::vec2& texcoord) {
-			vertex.texcoord = texcoord;
-			return vertex;
-		},
-		"WithNormal", [](skygfx::utils::Mesh::Vertex& vertex, const glm::vec3& normal) {
-			vertex.normal = normal;
-			return vertex;
-		},
-		"WithTangent", [](skygfx::utils::Mesh::Vertex& vertex, const glm::vec3& tangent) {
-			vertex.tangent = tangent;
-			return vertex;
-		},
-		"Pos", &skygfx::utils::Mesh::Vertex::pos,
-		"Color", &skygfx::utils::Mesh::Vertex::color,
-		"TexCoord", &skygfx::utils::Mesh::Vertex::texcoord,
-		"Normal", &skygfx::utils::Mesh::Vertex::normal,
-		"Tangent", &skygfx::utils::Mesh::Vertex::tangent
-	);
+	auto createVertexType = [&](auto withPos, auto withColor, auto withTexCoord, auto withNormal, auto withTangent) {
+		lua.new_usertype<skygfx::utils::Mesh::Vertex>("Vertex",
+			sol::call_constructor, BindCFunction<&NewVertex>("Vertex"),
+			"WithPos", withPos,
+			"WithColor", withColor,
+			"WithTexCoord", withTexCoord,
+			"WithNormal", withNormal,
+			"WithTangent", withTangent,
+			"Pos", &skygfx::utils::Mesh::Vertex::pos,
+			"Color", &skygfx::utils::Mesh::Vertex::color,
+			"TexCoord", &skygfx::utils::Mesh::Vertex::texcoord,
+			"Normal", &skygfx::utils::Mesh::Vertex::normal,
+			"Tangent", &skygfx::utils::Mesh::Vertex::tangent
+		);
+	};
+
+	if (trusted)
+	{
+		createVertexType(
+			BindCFunction<&TrustedVertexWith<&skygfx::utils::Mesh::Vertex::pos>>("Vertex.WithPos"),
+			BindCFunction<&TrustedVertexWith<&skygfx::utils::Mesh::Vertex::color>>("Vertex.WithColor"),
+			BindCFunction<&TrustedVertexWith<&skygfx::utils::Mesh::Vertex::texcoord>>("Vertex.WithTexCoord"),
+			BindCFunction<&TrustedVertexWith<&skygfx::utils::Mesh::Vertex::normal>>("Vertex.WithNormal"),
+			BindCFunction<&TrustedVertexWith<&skygfx::utils::Mesh::Vertex::tangent>>("Vertex.WithTangent")
+		);
+	}
+	else
+	{
+		createVertexType(
+			BindCFunction<&VertexWith<&skygfx::utils::Mesh::Vertex::pos>>("Vertex.WithPos"),
+			BindCFunction<&VertexWith<&skygfx::utils::Mesh::Vertex::color>>("Vertex.WithColor"),
+			BindCFunction<&VertexWith<&skygfx::utils::Mesh::Vertex::texcoord>>("Vertex.WithTexCoord"),
+			BindCFunction<&VertexWith<&skygfx::utils::Mesh::Vertex::normal>>("Vertex.WithNormal"),
+			BindCFunction<&VertexWith<&skygfx::utils::Mesh::Vertex::tangent>>("Vertex.WithTangent")
+		);
+	}
+
+	auto gfx = lua.create_named_table("Gfx",
+		"Clear", Bind("Gfx.Clear", [](float r, float g, float b, float a) {
+			skygfx::Clear(glm::vec4{ r, g, b, a });
+		}),
+		"Topology", createEnumTable.template operator()<skygfx::Topology>(),
+		"SetTopology", Bind("Gfx.SetTopology", [](int _topology) {
+			auto topology = magic_enum::enum_cast<skygfx::Topology>(_topology);
+			skygfx::SetTopology(topology.value());
+		}),
+		"Mode", createEnumTable.template operator()<skygfx::utils::MeshBuilder::Mode>(),
+		"Begin", Bind("Gfx.Begin", [&scratch](int _mode, std::optional<skygfx::utils::Scratch::State> state) {
+			auto mode = magic_enum::enum_cast<skygfx::utils::MeshBuilder::Mode>(_mode);
+			if (gLayerBlendMode.has_value())
+			{
+				auto layer_state = state.value_or(skygfx::utils::Scratch::State{});
+				layer_state.blend_mode = gLayerBlendMode.value();
+				scratch.begin(mode.value(), layer_state);
+			}
+			else if (state.has_value())
+				scratch.begin(mode.value(), state.value());
+			else
+				scratch.begin(mode.value());
+		}),
+		"Vertex", Bind("Gfx.Vertex", [&scratch](const skygfx::utils::Mesh::Vertex& vertex) {
+			scratch.vertex(vertex);
+		}),
+		// whole draw in one call, from array of vertices or packed floats
+		"Vertices", sol::overload(
+			Bind("Gfx.Vertices", [&scratch](const LuaFloat32Array& buffer, const VertexLayout& layout) {
+				layout.forEach(buffer.getSpan(), [&](const skygfx::utils::Mesh::Vertex& vertex) {
+					scratch.vertex(vertex);
+				});
+			}),
+			Bind("Gfx.Vertices", [&scratch](const sol::table& vertices) {
+				ForEachVertex(vertices, [&](const skygfx::utils::Mesh::Vertex& vertex) {
+					scratch.vertex(vertex);
+				});
+			})
+		),
+		"End", Bind("Gfx.End", [&scratch] {
+			scratch.end();
+		}),
+		"Flush", Bind("Gfx.Flush", [&scratch] {
+			scratch.flush();
+		})
+	);
+
+	if (trusted)
+	{
+		lua_pushlightuserdata(lua, &scratch);
+		lua_pushcclosure(lua, BindCFunction<&TrustedGfxVertex>("Gfx.Vertex"), 1);
+		gfx["Vertex"] = sol::stack::pop<sol::object>(lua);
+	}
+
+	lua_pushlightuserdata(lua, &scratch);
+	lua_pushcclosure(lua, BindCFunction<&GfxV>("Gfx.V"), 1);
+	gfx["V"] = sol::stack::pop<sol::object>(lua);
+
+	gfx.new_usertype<VertexLayout>("VertexLayout",
+		sol::call_constructor, sol::constructors<VertexLayout(const std::string&)>(),
+		"Stride", sol::readonly(&VertexLayout::stride)
+	);
+
+	gfx.new_usertype<GfxMesh>("Mesh",
+		sol::call_constructor, sol::no_constructor,
+		// overloads are matched by exact argument count, so forms without indices are listed too
+		"Create", sol::overload(
+			Bind("Mesh.Create", [](int topology, const sol::table& vertices) {
+				return std::make_shared<GfxMesh>(magic_enum::enum_cast<skygfx::Topology>(topology).value(),
+					ReadVertices(vertices), std::vector<uint32_t>());
+			}),
+			Bind("Mesh.Create", [](int topology, const sol::table& vertices, std::optional<sol::object> indices) {
+				return std::make_shared<GfxMesh>(magic_enum::enum_cast<skygfx::Topology>(topology).value(),
+					ReadVertices(vertices), ReadIndices(indices));
+			}),
+			Bind("Mesh.Create", [](int topology, const LuaFloat32Array& buffer, const VertexLayout& layout) {
+				return std::make_shared<GfxMesh>(magic_enum::enum_cast<skygfx::Topology>(topology).value(),
+					ReadVertices(buffer, layout), std::vector<uint32_t>());
+			}),
+			Bind("Mesh.Create", [](int topology, const LuaFloat32Array& buffer, const VertexLayout& layout,
+				std::optional<sol::object> indices) {
+				return std::make_shared<GfxMesh>(magic_enum::enum_cast<skygfx::Topology>(topology).value(),
+					ReadVertices(buffer, layout), ReadIndices(indices));
+			})
+		),
+		// partial update starting at 1-based vertex index
+		"SetVertices", sol::overload(
+			Bind("Mesh.SetVertices", [](GfxMesh& self, lua_Integer first, const sol::table& vertices) {
+				self.setVertices(ToVertexOffset(first), ReadVertices(vertices));
+			}),
+			Bind("Mesh.SetVertices", [](GfxMesh& self, lua_Integer first, const LuaFloat32Array& buffer,
+				const VertexLayout& layout) {
+				self.setVertices(ToVertexOffset(first), ReadVertices(buffer, layout));
+			})
+		),
+		"SetIndices", Bind("Mesh.SetIndices", [](GfxMesh& self, std::optional<sol::object> indices) {
+			self.setIndices(ReadIndices(indices));
+		}),
+		"Draw", Bind("Mesh.Draw", [&scratch](GfxMesh& self, std::optional<skygfx::utils::Scratch::State> state,
+			std::optional<glm::vec2> position, std::optional<glm::vec2> scale, std::optional<float> rotation) {
+			auto texture = state.has_value() ? state.value().texture : nullptr;
+			self.draw(scratch, texture, MakeModelMatrix(position, scale, rotation));
+		}),
+		// copies of mesh from Float32Array of InstanceStride floats per instance, see GfxMesh
+		"DrawInstances", Bind("Mesh.DrawInstances", [&scratch](GfxMesh& self, const LuaFloat32Array& instances,
+			std::optional<skygfx::utils::Scratch::State> state) {
+			auto texture = state.has_value() ? state.value().texture : nullptr;
+			self.drawInstances(scratch, texture, instances.getSpan());
+		}),
+		"InstanceStride", sol::var(GfxMesh::InstanceStride),
+		"VertexCount", sol::property(Bind<GfxMesh>("Mesh.VertexCount", &GfxMesh::getVertexCount)),
+		"IndexCount", sol::property(Bind<GfxMesh>("Mesh.IndexCount", &GfxMesh::getIndexCount))
+	);
+
+	// if layer.Dirty then layer:Begin() ... layer:End() end layer:Draw()
+	gfx.new_usertype<GfxLayer>("Layer",
+		sol::call_constructor, sol::no_constructor,
+		"Create", Bind("Layer.Create", [] {
+			return std::make_shared<GfxLayer>();
+		}),
+		"Dirty", sol::property(Bind<GfxLayer>("Layer.Dirty", &GfxLayer::isDirty)),
+		"Invalidate", Bind<GfxLayer>("Layer.Invalidate", &GfxLayer::invalidate),
+		"Begin", Bind("Layer.Begin", [&scratch](GfxLayer& self) {
+			self.begin(scratch);
+		}),
+		"End", Bind("Layer.End", [&scratch](GfxLayer& self) {
+			self.end(scratch);
+		}),
+		"Draw", Bind("Layer.Draw", [&scratch](GfxLayer& self) {
+			self.draw(scratch);
+		}),
+		"Texture", sol::property(Bind<GfxLayer>("Layer.Texture", &GfxLayer::getTexture))
+	);
+
+	gfx.new_usertype<skygfx::utils::Scratch::State>("State",
+		sol::call_constructor, sol::constructors<skygfx::utils::Scratch::State()>(),
+		"WithTexture", sol::overload(
+			Bind("State.WithTexture", [](skygfx::utils::Scratch::State& state, std::shared_ptr<skygfx::Texture> texture) {
+				state.texture = texture.get();
+				return state;
+			}),
+			// texcoords of vertices are expected to be mapped by region UV
+			Bind("State.WithTexture", [](skygfx::utils::Scratch::State& state, std::shared_ptr<TextureAtlas::Region> region) {
+				state.texture = region->texture.get();
+				return state;
+			})
+		)
+	);
+
+	// sub rect of atlas page or whole texture, follows its image when atlas is repacked
+	gfx.new_usertype<TextureAtlas::Region>("TextureRegion",
+		sol::call_constructor, sol::no_constructor,
+		"Texture", sol::readonly(&TextureAtlas::Region::texture),
+		"UV", sol::readonly(&TextureAtlas::Region::uv),
+		"Size", sol::property(Bind("TextureRegion.Size", [](const TextureAtlas::Region& self) {
+			return self.tex_region.size;
+		}))
+	);
+
+	gfx.new_usertype<skygfx::Texture>("Texture",
+		sol::call_constructor, sol::no_constructor,
+		"FromPixels", Bind("Texture.FromPixels", [](lua_Integer width, lua_Integer height, sol::stack_object pixels) {
+			if (width <= 0 || height <= 0 || width > UINT32_MAX || height > UINT32_MAX)
+				throw std::out_of_range("texture size must be positive");
+
+			auto bytes = ReadPixels(pixels, (uint32_t)width, (uint32_t)height);
+			auto texture = std::make_shared<skygfx::Texture>((uint32_t)width, (uint32_t)height, skygfx::PixelFormat::RGBA8UNorm);
+			texture->write((uint32_t)width, (uint32_t)height, skygfx::PixelFormat::RGBA8UNorm, bytes.data());
+			return MakeWritable(texture);
+		}),
+		// decoded on worker, future resolves with texture, or nil and error
+		"FromEncoded", Bind("Texture.FromEncoded", [&scheduler](const LuaBlob& blob, std::optional<sol::table> options) {
+			auto future = scheduler.createFuture();
+			auto weak_future = std::weak_ptr<LuaFuture>(future);
+			const auto& data = blob.getData();
+			gTextureLoader->decode(data.data(), data.size(), ReadTextureOptions(options), [weak_future](const TextureLoader::Result& result) {
+				if (auto future = weak_future.lock())
+				{
+					future->resolve([texture = MakeWritable(TextureCache::MakeTexture(result.image, result.mips))](lua_State* L) {
+						return sol::stack::push(L, texture);
+					});
+				}
+			}, MakeFailedResolver(weak_future, "decode failed"));
+			return future;
+		}),
+		// sub rect update, for images that change every frame. Only textures made from pixels or encoded image
+		// are written, rect is checked in lua integers, so negative and huge values are not wrapped
+		"Write", Bind("Texture.Write", [](skygfx::Texture& self, lua_Integer x, lua_Integer y, lua_Integer width, lua_Integer height,
+			sol::stack_object pixels) {
+			if (!IsWritable(self))
+				throw std::runtime_error("only textures made by FromPixels or FromEncoded can be written");
+
+			if (width <= 0 || height <= 0)
+				throw std::out_of_range("rect size must be positive");
+
+			if (x < 0 || y < 0 || x > (lua_Integer)self.getWidth() - width || y > (lua_Integer)self.getHeight() - height)
+				throw std::out_of_range("rect is out of texture bounds");
+
+			auto bytes = ReadPixels(pixels, (uint32_t)width, (uint32_t)height);
+			self.write((uint32_t)width, (uint32_t)height, skygfx::PixelFormat::RGBA8UNorm, bytes.data(), 0, (uint32_t)x, (uint32_t)y);
+		}),
+		"Width", sol::property(Bind<skygfx::Texture>("Texture.Width", &skygfx::Texture::getWidth)),
+		"Height", sol::property(Bind<skygfx::Texture>("Texture.Height", &skygfx::Texture::getHeight))
+	);
+
+	// glm
+
+	MakeVectorType<glm::vec2>(lua, "Vec2",
+		sol::call_constructor, sol::constructors<glm::vec2(), glm::vec2(float, float)>(),
+		"X", &glm::vec2::x,
+		"Y", &glm::vec2::y,
+		"Set", BindCFunction<CFunction<&SetVec2>>("Vec2.Set")
+	);
+
+	MakeVectorType<glm::vec3>(lua, "Vec3",
+		sol::call_constructor, sol::constructors<glm::vec3(), glm::vec3(float, float, float)>(),
+		"X", &glm::vec3::x,
+		"Y", &glm::vec3::y,
+		"Z", &glm::vec3::z,
+		"Set", BindCFunction<CFunction<&SetVec3>>("Vec3.Set"),
+		"Cross", BindCFunction<CFunction<&CrossVec3>>("Vec3.Cross")
+	);
+
+	MakeVectorType<glm::vec4>(lua, "Vec4",
+		sol::call_constructor, sol::constructors<glm::vec4(), glm::vec4(float, float, float, float)>(),
+		"X", &glm::vec4::x,
+		"Y", &glm::vec4::y,
+		"Z", &glm::vec4::z,
+		"W", &glm::vec4::w,
+		"Set", BindCFunction<CFunction<&SetVec4>>("Vec4.Set")
+	);
+
+	auto fetch_texture = [url_base](std::string url, std::function<void(std::shared_ptr<skygfx::Texture>)> callback,
+		std::optional<sol::table> options, DownloadFailedCallback failedCallback) {
+		LoadTexture(url_base + url, false, ReadTextureOptions(options), [callback](std::shared_ptr<TextureAtlas::Region> region) {
+			callback(region->texture);
+		}, failedCallback);
+	};
+
+	auto fetch_texture_region = [url_base](std::string url, TextureRegionCallback callback,
+		std::optional<sol::table> options, DownloadFailedCallback failedCallback) {
+		LoadTexture(url_base + url, true, ReadTextureOptions(options), callback, failedCallback);
+	};
+
+	// without callback fetches return future for Await, host callbacks hold it weakly,
+	// so nothing is resolved after app is closed
+
+	lua["Fetch"] = sol::overload(
+		Bind("Fetch", [&scheduler](const std::string& url) {
+			auto future = scheduler.createFuture();
+			auto weak_future = std::weak_ptr<LuaFuture>(future);
+			DownloadFileToMemory(url, [weak_future](void* memory, size_t size) {
+				if (auto future = weak_future.lock())
+				{
+					future->resolve([data = std::string((char*)memory, size)](lua_State* L) {
+						lua_pushlstring(L, data.data(), data.size());
+						return 1;
+					});
+				}
+			}, MakeFailedResolver(weak_future, "fetch failed"));
+			return future;
+		}),
+		// overloads are matched by exact argument count, so onfail gets its own
+		Bind("Fetch (callback)", [](const std::string& url, std::function<void(size_t memory, size_t size)> callback) {
+			DownloadFileToMemory(url, [callback](void* memory, size_t size) {
+				callback((size_t)memory, size);
+			});
+		}),
+		Bind("Fetch (callback)", [](const std::string& url, std::function<void(size_t memory, size_t size)> callback, std::optional<std::function<void()>> onfail) {
+			DownloadFileToMemory(url, [callback](void* memory, size_t size) {
+				callback((size_t)memory, size);
+			}, onfail.value_or(nullptr));
+		})
+	);
+
+	auto fetch_texture_future = [&scheduler, fetch_texture](std::string url, std::optional<sol::table> options) {
+		auto future = scheduler.createFuture();
+		auto weak_future = std::weak_ptr<LuaFuture>(future);
+		fetch_texture(url, [weak_future](std::shared_ptr<skygfx::Texture> texture) {
+			if (auto future = weak_future.lock())
+			{
+				future->resolve([texture](lua_State* L) {
+					return sol::stack::push(L, texture);
+				});
+			}
+		}, options, MakeFailedResolver(weak_future, "fetch failed"));
+		return future;
+	};
+
+	auto fetch_texture_region_future = [&scheduler, fetch_texture_region](std::string url, std::optional<sol::table> options) {
+		auto future = scheduler.createFuture();
+		auto weak_future = std::weak_ptr<LuaFuture>(future);
+		fetch_texture_region(url, [weak_future](std::shared_ptr<TextureAtlas::Region> region) {
+			if (auto future = weak_future.lock())
+			{
+				future->resolve([region](lua_State* L) {
+					return sol::stack::push(L, region);
+				});
+			}
+		}, options, MakeFailedResolver(weak_future, "fetch failed"));
+		return future;
+	};
+
+	// every argument count gets its own overload, options go before callback ones,
+	// since nil passes as empty callback
+
+	lua["FetchTexture"] = sol::overload(
+		Bind("FetchTexture", [fetch_texture_future](std::string url) {
+			return fetch_texture_future(url, std::nullopt);
+		}),
+		Bind("FetchTexture", [fetch_texture_future](std::string url, std::optional<sol::table> options) {
+			return fetch_texture_future(url, options);
+		}),
+		Bind("FetchTexture (callback)", [fetch_texture](std::string url, std::function<void(std::shared_ptr<skygfx::Texture>)> callback) {
+			fetch_texture(url, callback, std::nullopt, nullptr);
+		}),
+		Bind("FetchTexture (callback)", [fetch_texture](std::string url, std::function<void(std::shared_ptr<skygfx::Texture>)> callback,
+			std::optional<sol::table> options) {
+			fetch_texture(url, callback, options, nullptr);
+		})
+	);
+
+	// small images are packed into shared atlas pages, so many of them are drawn without texture switches
+	lua["FetchTextureRegion"] = sol::overload(
+		Bind("FetchTextureRegion", [fetch_texture_region_future](std::string url) {
+			return fetch_texture_region_future(url, std::nullopt);
+		}),
+		Bind("FetchTextureRegion", [fetch_texture_region_future](std::string url, std::optional<sol::table> options) {
+			return fetch_texture_region_future(url, options);
+		}),
+		Bind("FetchTextureRegion (callback)", [fetch_texture_region](std::string url, TextureRegionCallback callback) {
+			fetch_texture_region(url, callback, std::nullopt, nullptr);
+		}),
+		Bind("FetchTextureRegion (callback)", [fetch_texture_region](std::string url, TextureRegionCallback callback,
+			std::optional<sol::table> options) {
+			fetch_texture_region(url, callback, options, nullptr);
+		})
+	);
+
+	// scene
+
+	auto scene = lua.create_named_table("Scene");
+
+	scene["Root"] = std::static_pointer_cast<Scene::Node>(canvas);
+
+	scene.new_usertype<Scene::Transform>("Transform",
+		"new", sol::no_constructor,
+		"Size", BindProperty<Scene::Transform>("Transform.Size", &Scene::Transform::getSize,  sol::resolve<void(const glm::vec2&)>(&Scene::Transform::setSize)),
+		"Width", BindProperty<Scene::Transform>("Transform.Width", &Scene::Transform::getWidth, &Scene::Transform::setWidth),
+		"Height", BindProperty<Scene::Transform>("Transform.Height", &Scene::Transform::getHeight, &Scene::Transform::setHeight),
+		"Anchor", BindProperty<Scene::Transform>("Transform.Anchor", &Scene::Transform::getAnchor, sol::resolve<void(const glm::vec2&)>(&Scene::Transform::setAnchor)),
+		"Pivot", BindProperty<Scene::Transform>("Transform.Pivot", &Scene::Transform::getPivot, sol::resolve<void(const glm::vec2&)>(&Scene::Transform::setPivot)),
+		"Stretch", BindProperty<Scene::Transform>("Transform.Stretch", &Scene::Transform::getStretch, sol::resolve<void(const glm::vec2&)>(&Scene::Transform::setStretch)),
+		"Position", BindProperty<Scene::Transform>("Transform.Position", &Scene::Transform::getPosition, sol::resolve<void(const glm::vec2&)>(&Scene::Transform::setPosition)),
+		"X", BindProperty<Scene::Transform>("Transform.X", &Scene::Transform::getX, &Scene::Transform::setX),
+		"Y", BindProperty<Scene::Transform>("Transform.Y", &Scene::Transform::getY, &Scene::Transform::setY)
+	);
+	scene.new_usertype<Scene::Node>("Node",
+		sol::base_classes, sol::bases<Scene::Transform>(),
+		sol::call_constructor, sol::no_constructor,
+		"Attach", Bind("Node.Attach", [](std::shared_ptr<Scene::Node> self, std::shared_ptr<Scene::Node> node) {
+			self->attach(node);
+		}),
+		"Touchable", BindProperty<Scene::Node>("Node.Touchable", &Scene::Node::isTouchable, &Scene::Node::setTouchable)
+	);
+	scene.new_usertype<Scene::Color>("Color",
+		sol::call_constructor, sol::no_constructor,
+		"Color", BindProperty<Scene::Color>("Color.Color", &Scene::Color::getColor, sol::resolve<void(const glm::vec4&)>(&Scene::Color::setColor))
+	);
+
+	auto createEdgeProperty = [](Scene::Rectangle::Edge edge) {
+		return BindProperty(std::format("Rectangle.{}Color", magic_enum::enum_name(edge)), [edge](const Scene::Rectangle& self) {
+			return self.getEdgeColor(edge)->getColor();
+		}, [edge](Scene::Rectangle& self, const glm::vec4& color) {
+			self.getEdgeColor(edge)->setColor(color);
+		});
+	};
+
+	auto createCornerProperty = [](Scene::Rectangle::Corner corner) {
+		return BindProperty(std::format("Rectangle.{}Color", magic_enum::enum_name(corner)), [corner](const Scene::Rectangle& self) {
+			return self.getCornerColor(corner)->getColor();
+		}, [corner](Scene::Rectangle& self, const glm::vec4& color) {
+			self.getCornerColor(corner)->setColor(color);
+		});
+	};
+
+	scene.new_usertype<Scene::Rectangle>("Rectangle",
+		sol::base_classes, sol::bases<Scene::Node, Scene::Transform, Scene::Color>(),
+		sol::call_constructor, sol::no_constructor,
+		"Create", Bind("Rectangle.Create", [] {
+			return std::make_shared<Scene::Rectangle>();
+		}),
+		"Edge", createEnumTable.template operator()<Scene::Rectangle::Edge>(),
+		"Corner", createEnumTable.template operator()<Scene::Rectangle::Corner>(),
+		"GetEdgeColor", Bind<Scene::Rectangle>("Rectangle.GetEdgeColor", &Scene::Rectangle::getEdgeColor),
+		"GetCornerColor", Bind<Scene::Rectangle>("Rectangle.GetCornerColor", &Scene::Rectangle::getCornerColor),
+		"Rounding", BindProperty<Scene::Rectangle>("Rectangle.Rounding", &Scene::Rectangle::getRounding, &Scene::Rectangle::setRounding),
+		"AbsoluteRounding", BindProperty<Scene::Rectangle>("Rectangle.AbsoluteRounding", &Scene::Rectangle::isAbsoluteRounding, &Scene::Rectangle::setAbsoluteRounding),
+		"TopColor", createEdgeProperty(Scene::Rectangle::Edge::Top),
+		"BottomColor", createEdgeProperty(Scene::Rectangle::Edge::Bottom),
+		"LeftColor", createEdgeProperty(Scene::Rectangle::Edge::Left),
+		"RightColor", createEdgeProperty(Scene::Rectangle::Edge::Right),
+		"TopLeftColor", createCornerProperty(Scene::Rectangle::Corner::TopLeft),
+		"TopRightColor", createCornerProperty(Scene::Rectangle::Corner::TopRight),
+		"BottomLeftColor", createCornerProperty(Scene::Rectangle::Corner::BottomLeft),
+		"BottomRightColor", createCornerProperty(Scene::Rectangle::Corner::BottomRight)
+	);
+
+	scene.new_usertype<Scene::Sprite>("Sprite",
+		sol::base_classes, sol::bases<Scene::Node, Scene::Transform, Scene::Color>(),
+		sol::call_constructor, sol::no_constructor,
+		"Create", Bind("Sprite.Create", [] {
+			return std::make_shared<Scene::Sprite>();
+		}),
+		"Texture", BindProperty<Scene::Sprite>("Sprite.Texture", &Scene::Sprite::getTexture, sol::resolve<void(std::shared_ptr<skygfx::Texture>)>(&Scene::Sprite::setTexture)),
+		"SetTextureRegion", Bind("Sprite.SetTextureRegion", [](std::shared_ptr<Scene::Sprite> self, std::shared_ptr<TextureAtlas::Region> region) {
+			SetSpriteRegion(self, region);
+		})
+	);
+
+	scene.new_usertype<Scene::Label>("Label",
+		sol::base_classes, sol::bases<Scene::Node, Scene::Transform, Scene::Color>(),
+		sol::call_constructor, sol::no_constructor,
+		"Create", Bind("Label.Create", [] {
+			return std::make_shared<Scene::Label>();
+		}),
+		"Text", BindProperty("Label.Text", &GetLabelText, &SetLabelText),
+		"FontSize", BindProperty<Scene::Label>("Label.FontSize", &Scene::Label::getFontSize, &Scene::Label::setFontSize),
+		"GetOutlineColor", Bind<Scene::Label>("Label.GetOutlineColor", &Scene::Label::getOutlineColor),
+		"OutlineColor", BindProperty("Label.OutlineColor", [](const Scene::Label& self) {
+			return self.getOutlineColor()->getColor();
+		}, [](Scene::Label& self, const glm::vec4& color) {
+			self.getOutlineColor()->setColor(color);
+		}),
+		"OutlineThickness", BindProperty<Scene::Label>("Label.OutlineThickness", &Scene::Label::getOutlineThickness, &Scene::Label::setOutlineThickness)
+	);
+
+	auto physics = lua.create_table_with(
+		"EntityType", createEnumTable.template operator()<Shared::PhysHelpers::Entity::Type>(),
+		"EntityShape", createEnumTable.template operator()<Shared::PhysHelpers::Entity::Shape>()
+	);
+
+	physics.new_usertype<Shared::PhysHelpers::World>("World",
+		sol::base_classes, sol::bases<Scene::Node, Scene::Transform>(),
+		sol::call_constructor, sol::no_constructor,
+		"Create", Bind("World.Create", [] {
+			return std::make_shared<Shared::PhysHelpers::World>();
+		})
+	);
+
+	physics.new_usertype<Shared::PhysHelpers::Entity>("Entity",
+		sol::base_classes, sol::bases<Scene::Node, Scene::Transform>(),
+		sol::call_constructor, sol::no_constructor,
+		"Create", Bind("Entity.Create", [] {
+			return std::make_shared<Shared::PhysHelpers::Entity>();
+		}),
+		"Type", BindProperty<Shared::PhysHelpers::Entity>("Entity.Type", &Shared::PhysHelpers::Entity::getType, &Shared::PhysHelpers::Entity::setType),
+		"Shape", BindProperty<Shared::PhysHelpers::Entity>("Entity.Shape", &Shared::PhysHelpers::Entity::getShape, &Shared::PhysHelpers::Entity::setShape)
+	);
+
+	scene["Physics"] = physics;
+
+	scene.new_usertype<StandardButton>("StandardButton",
+		sol::base_classes, sol::bases<Scene::Rectangle, Scene::Node, Scene::Transform, Scene::Color>(),
+		sol::call_constructor, sol::no_constructor,
+		"Create", Bind("StandardButton.Create", [] {
+			return std::make_shared<StandardButton>();
+		}),
+		"OnClick", BindProperty<StandardButton>("StandardButton.OnClick", &StandardButton::getClickCallback, &StandardButton::setClickCallback),
+		"Text", BindProperty("StandardButton.Text",
+			[](StandardButton& self) { return GetLabelText(*self.getLabel()); },
+			[](StandardButton& self, std::string_view text) { SetLabelText(*self.getLabel(), text); }
+		),
+		"Label", sol::property(Bind("StandardButton.Label", [](StandardButton& self) {
+			return std::static_pointer_cast<Scene::Label>(self.getLabel());
+		}))
+	);
+
+	// imscene
+
+	auto imscene = lua.create_named_table("ImScene",
+		"IsFirstCall", Bind("ImScene.IsFirstCall", [] {
+			return IMSCENE->isFirstCall();
+		}),
+		"SpawnRectangle", Bind("ImScene.SpawnRectangle", [](std::shared_ptr<Scene::Node> holder, std::optional<std::string> key) {
+			return IMSCENE->spawn<Scene::Rectangle>(*holder, key);
+		}),
+		"SpawnLabel", Bind("ImScene.SpawnLabel", [](std::shared_ptr<Scene::Node> holder, std::optional<std::string> key) {
+			return IMSCENE->spawn<Scene::Label>(*holder, key);
+		}),
+		"SpawnSprite", Bind("ImScene.SpawnSprite", [](std::shared_ptr<Scene::Node> holder, std::optional<std::string> key) {
+			return IMSCENE->spawn<Scene::Sprite>(*holder, key);
+		}),
+		"IsMouseHovered", Bind("ImScene.IsMouseHovered", [](std::shared_ptr<Scene::Node> node) {
+			return Shared::SceneHelpers::ImScene::IsMouseHovered(*node);
+		}),
+		"Tooltip", Bind("ImScene.Tooltip", [](std::shared_ptr<Scene::Node> holder, std::string_view text) {
+			static std::wstring buffer;
+			Utf8ToWide(text, buffer);
+			Shared::SceneHelpers::ImScene::Tooltip(*holder, buffer);
+		})
+	);
+}
+
+static void BenchmarkBindings(int iterations)
+{
+	struct Benchmark
+	{
+		std::string name;
+		std::string code;
+	};
 
-	auto gfx = lua.create_named_table("Gfx",
-		"Clear", [](float r, float g, float b, float a) {
-			skygfx::Clear(glm::vec4{ r, g, b, a });
-		},
-		"Topology", createEnumTable.template operator()<skygfx::Topology>(),
-		"SetTopology", [](int _topology) {
-			auto topology = magic_enum::enum_cast<skygfx::Topology>(_topology);
-			skygfx::SetTopology(topology.value());
-		},
-		"Mode", createEnumTable.template operator()<skygfx::utils::MeshBuilder::Mode>(),
-		"Begin", [](int _mode, std::optional<skygfx::utils::Scratch::State> state) {
-			auto mode = magic_enum::enum_cast<skygfx::utils::MeshBuilder::Mode>(_mode);
-			if (state.has_value())
-				gScratch.begin(mode.value(), state.value());
-			else
-				gScratch.begin(mode.value());
-		},
-		"Vertex", [](const skygfx::utils::Mesh::Vertex& vertex) {
-			gScratch.vertex(vertex);
-		},
-		"End", [] {
-			gScratch.end();
-		},
-		"Flush", [] {
-			gScratch.flush();
+	const auto benchmarks = std::vector<Benchmark>{
+		{ "Vertex:WithPos", "local v = Vertex() local a = Vec3(1, 2, 3) for i = 1, Iterations do v = v:WithPos(a) end" },
+		{ "Vertex:WithColor", "local v = Vertex() local a = Vec4(1, 1, 1, 1) for i = 1, Iterations do v = v:WithColor(a) end" },
+		{ "Vertex:WithTexCoord", "local v = Vertex() local a = Vec2(0, 1) for i = 1, Iterations do v = v:WithTexCoord(a) end" },
+		{ "Vertex:WithNormal", "local v = Vertex() local a = Vec3(0, 0, 1) for i = 1, Iterations do v = v:WithNormal(a) end" },
+	};
+
+	auto run = [&](bool trusted) {
+		auto lua = sol::state();
+		lua.open_libraries();
+		auto scheduler = LuaScheduler(lua.lua_state(), nullptr);
+		auto scratch = skygfx::utils::Scratch();
+		MakeApi(lua, "", std::make_shared<Scene::Node>(), scheduler, scratch, trusted);
+		lua["Iterations"] = iterations;
+
+		auto measure = [&](const std::string& code) {
+			auto start = std::chrono::steady_clock::now();
+			auto res = lua.safe_script(code, sol::script_pass_on_error);
+			if (!res.valid())
+				HandleError(res);
+			return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+		};
+
+		// loop and upvalue access are not part of binding cost
+		auto baseline = measure("local v = Vertex() for i = 1, Iterations do v = v end");
+
+		auto result = std::vector<double>();
+		for (const auto& benchmark : benchmarks)
+		{
+			result.push_back(measure(benchmark.code) - baseline);
 		}
-	);
+		return result;
+	};
 
-	gfx.new_usertype<skygfx::utils::Scratch::State>("State",
-		sol::call_constructor, sol::constructors<skygfx::utils::Scratch::State()>(),
-		"WithTexture", [](skygfx::utils::Scratch::State& state, std::shared_ptr<skygfx::Texture> texture) {
-			state.texture = texture.get();
-			return state;
+	auto checked = run(false);
+	auto trusted = run(true);
+
+	for (size_t i = 0; i < benchmarks.size(); i++)
+	{
+		sky::Log("{}: checked {:.1f} ns, trusted {:.1f} ns, x{:.2f}", benchmarks[i].name, checked[i], trusted[i],
+			checked[i] / trusted[i]);
+	}
+}
+
+App::App(std::string url_base, AppOptions options) :
+	mUrlBase(url_base),
+	mOptions(options)
+{
+	setStretch(1.0f);
+	setColor(Graphics::Color::Black);
+
+	mCanvas = std::make_shared<App::Canvas>();
+	mCanvas->setStretch(1.0f);
+	mCanvas->setDrawCallback([this] {
+		GRAPHICS->flush();
+		drawCanvas();
+	});
+	attach(mCanvas);
+
+	auto button = std::make_shared<StandardButton>();
+	button->setPosition({ 32.0f, 32.0f });
+	button->setSize({ 96.0f, 32.0f });
+	button->getLabel()->setText(L"EXIT");
+	button->setClickCallback([] {
+		CONSOLE->execute("exit");
+	});
+	attach(button);
+}
+
+App::~App()
+{
+	GfxLayer::Recover();
+	mCanvas->clear(); // we need clear childs of canvas before sol state cleared
+	mHeapProfiler.setState(nullptr);
+}
+
+void App::drawCanvas()
+{
+	if (!mSolState || mSuspended)
+		return;
+
+	auto delta = Clock::ToSeconds(FRAME->getTimeDelta());
+
+	armWatchdog(std::chrono::milliseconds(mOptions.frame_budget_ms));
+
+	// iterating by index, callbacks can subscribe new callbacks while called
+
+	for (size_t i = 0; i < mFixedUpdateCallbacks.size(); i++)
+	{
+		constexpr int MaxStepsPerFrame = 5; // avoid spiral of death when frames are slow
+
+		auto& callback = mFixedUpdateCallbacks[i];
+		callback.accumulator = glm::min(callback.accumulator + delta, callback.step * MaxStepsPerFrame);
+
+		while (!callback.removed && callback.accumulator >= callback.step)
+		{
+			callback.accumulator -= callback.step;
+			callFrameCallback(callback, callback.step);
+		}
+	}
+
+	for (size_t i = 0; i < mUpdateCallbacks.size(); i++)
+	{
+		callFrameCallback(mUpdateCallbacks[i], delta);
+	}
+
+	mScheduler->update(delta);
+	dispatchWorkerMessages();
+
+	if (mDrawCallbacks.empty())
+		resolveLegacyFrame();
+	else
+		mLegacyFrame.reset();
+
+	if (mLegacyFrame.has_value() || !mDrawCallbacks.empty())
+	{
+		auto draw = [&](FrameCallback& callback) {
+			if (callFrameCallback(callback, delta))
+				return;
+
+			if (mScratch.isBegan())
+				mScratch.end();
+
+			GfxLayer::Recover();
+		};
+
+		if (mLegacyFrame.has_value())
+			draw(mLegacyFrame.value());
+
+		for (size_t i = 0; i < mDrawCallbacks.size(); i++)
+		{
+			draw(mDrawCallbacks[i]);
+		}
+		try
+		{
+			mScratch.flush();
+		}
+		catch (const std::exception& e)
+		{
+			sky::Log(Console::Color::Red, e.what());
+		}
+	}
+
+	// layer may be begun by update callbacks or coroutines as well
+	GfxLayer::Recover();
+
+	disarmWatchdog();
+
+	// unsubscribed callbacks are only marked during frame, remove them here
+	auto is_removed = [](const auto& callback) { return callback.removed; };
+	std::erase_if(mFixedUpdateCallbacks, is_removed);
+	std::erase_if(mUpdateCallbacks, is_removed);
+	std::erase_if(mDrawCallbacks, is_removed);
+
+	stepGarbageCollector();
+}
+
+bool App::callFrameCallback(FrameCallback& callback, float delta)
+{
+	if (callback.removed)
+		return true;
+
+	auto res = callback.func(delta);
+
+	if (res.valid())
+		return true;
+
+	HandleError(res);
+	return false;
+}
+
+int App::subscribe(std::deque<FrameCallback>& callbacks, sol::protected_function func)
+{
+	auto id = ++mFrameCallbackId;
+	callbacks.push_back({ id, func });
+	return id;
+}
+
+void App::unsubscribe(int id)
+{
+	auto invalidate = [id](auto& callbacks) {
+		for (auto& callback : callbacks)
+		{
+			if (callback.id == id)
+				callback.removed = true;
+		}
+	};
+	invalidate(mFixedUpdateCallbacks);
+	invalidate(mUpdateCallbacks);
+	invalidate(mDrawCallbacks);
+}
+
+// legacy entry, global Frame is called as draw callback while app has no other ones. It is looked up
+// every frame, apps define it late, e.g. in fetch callback, or replace it to switch states.
+// Reference is renewed only when function changes
+
+void App::resolveLegacyFrame()
+{
+	auto L = mSolState->lua_state();
+	lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+	lua_pushliteral(L, "Frame");
+	lua_rawget(L, -2);
+
+	if (!lua_isfunction(L, -1))
+	{
+		mLegacyFrame.reset();
+		lua_pop(L, 2);
+		return;
+	}
+
+	auto changed = true;
+
+	if (mLegacyFrame.has_value())
+	{
+		mLegacyFrame->func.push(L);
+		changed = !lua_rawequal(L, -1, -2);
+		lua_pop(L, 1);
+	}
+
+	if (changed)
+		mLegacyFrame = FrameCallback{ 0, sol::protected_function(L, -1) };
+
+	lua_pop(L, 2);
+}
+
+void App::dispatchWorkerMessages()
+{
+	std::erase_if(mWorkers, [](const auto& worker) {
+		return worker.expired();
+	});
+
+	for (size_t i = 0; i < mWorkers.size(); i++)
+	{
+		auto worker = mWorkers[i].lock(); // OnMessage can create new workers or collect old ones
+		if (!worker)
+			continue;
+
+		worker->dispatch(mSolState->lua_state(), [](const std::string& error) {
+			sky::Log(Console::Color::Red, "RUNTIME ERROR: {}", error);
+		});
+	}
+}
+
+void App::clearFrameCallbacks()
+{
+	mFixedUpdateCallbacks.clear();
+	mUpdateCallbacks.clear();
+	mDrawCallbacks.clear();
+	mLegacyFrame.reset();
+}
+
+void App::applyGCMode()
+{
+	auto L = mSolState->lua_state();
+
+	if (mOptions.gc_mode == AppOptions::GCMode::Generational)
+	{
+		lua_gc(L, LUA_GCGEN, 0, 0);
+		lua_gc(L, LUA_GCRESTART);
+	}
+	else
+	{
+		// automatic collector stays stopped, otherwise its steps run inside lua callbacks out of gc budget.
+		// Host backstops are full collections after entry point, in background, and when heap outgrows stepping.
+		// Allocation failure still collects fully before giving up
+		lua_gc(L, LUA_GCINC, 0, 0, 0);
+		lua_gc(L, LUA_GCSTOP);
+	}
+}
+
+void App::collectGarbage()
+{
+	auto L = mSolState->lua_state();
+	lua_gc(L, LUA_GCCOLLECT);
+	mGCStats.cycles += 1;
+	mGCStats.heap_after_cycle = (size_t)lua_gc(L, LUA_GCCOUNT) * 1024;
+}
+
+void App::setGCMode(AppOptions::GCMode value)
+{
+	mOptions.gc_mode = value;
+
+	if (mSolState)
+		applyGCMode();
+}
+
+void App::stepGarbageCollector()
+{
+	using namespace std::chrono;
+
+	auto L = mSolState->lua_state();
+	auto budget = microseconds(mOptions.gc_budget_us);
+	auto start = steady_clock::now();
+	auto heap = (size_t)lua_gc(L, LUA_GCCOUNT) * 1024;
+
+	if (mOptions.gc_mode == AppOptions::GCMode::Generational)
+	{
+		// minor collection cannot be split, so do it only when last one fitted into budget
+		if (mGCStats.minor_estimate > budget)
+		{
+			mGCStats.minor_estimate -= mGCStats.minor_estimate / 8; // decay, retry later
+			mGCStats.frame_time = {};
+			return;
+		}
+
+		lua_gc(L, LUA_GCSTEP, 0);
+		mGCStats.cycles += 1;
+		mGCStats.minor_estimate = duration_cast<microseconds>(steady_clock::now() - start);
+	}
+	else
+	{
+		constexpr size_t HeapSlack = 1024 * 1024; // small heaps grow by this much before stepping speeds up
+
+		// allocation outpaces stepping, let collector catch up before heap explodes,
+		// when even that was not enough, collect fully in one pause
+		if (mGCStats.heap_after_cycle > 0 && heap > mGCStats.heap_after_cycle * 4 + HeapSlack)
+		{
+			collectGarbage();
+			budget = {};
+		}
+		else if (mGCStats.heap_after_cycle > 0 && heap > mGCStats.heap_after_cycle * 2 + HeapSlack)
+		{
+			budget *= 4;
+		}
+
+		while (steady_clock::now() - start < budget)
+		{
+			if (lua_gc(L, LUA_GCSTEP, 0) == 0)
+				continue;
+
+			mGCStats.cycles += 1;
+			mGCStats.heap_after_cycle = (size_t)lua_gc(L, LUA_GCCOUNT) * 1024;
+			break;
 		}
+	}
+
+	auto now = steady_clock::now();
+	mGCStats.frame_time = duration_cast<microseconds>(now - start);
+
+	if (now - mGCStats.max_pause_start > seconds(1))
+	{
+		mGCStats.max_pause = {};
+		mGCStats.max_pause_start = now;
+	}
+
+	mGCStats.max_pause = std::max(mGCStats.max_pause, mGCStats.frame_time);
+}
+
+static constexpr int WatchdogHookInstructions = 1000;
+static constexpr auto WatchdogFallbackBudget = std::chrono::seconds(1); // for lua entered outside of armed calls
+
+void App::armWatchdog(std::chrono::milliseconds budget)
+{
+	mProfiler.restart();
+	mWatchdogDeadline = std::chrono::steady_clock::now() + budget;
+	mWatchdogBlockingTime = gHostBlockingTime;
+	mWatchdogTriggered = false;
+}
+
+void App::disarmWatchdog()
+{
+	mWatchdogDeadline.reset();
+
+	if (!mWatchdogTriggered)
+	{
+		mFrameOverruns = 0;
+		return;
+	}
+
+	mWatchdogTriggered = false;
+	mFrameOverruns += 1;
+
+	if (mFrameOverruns < mOptions.max_frame_overruns)
+		return;
+
+	mSuspended = true;
+	GfxLayer::Recover();
+	sky::Log(Console::Color::Red, "app suspended after {} frame budget overruns, type lua_continue to resume", mFrameOverruns);
+}
+
+void App::resume()
+{
+	mSuspended = false;
+	mFrameOverruns = 0;
+}
+
+void App::setBackground(bool value)
+{
+	if (mBackground == value)
+		return;
+
+	mBackground = value;
+
+	if (!mBackground)
+		return;
+
+	GfxLayer::Recover();
+
+	if (!mSolState)
+		return;
+
+	// nothing runs until resume, so full collection pause is not visible
+	auto start = std::chrono::steady_clock::now();
+	auto bytes_before = mLuaAllocator.getBytes();
+	collectGarbage();
+	mLuaAllocator.trim();
+	auto time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+	sky::Log("app moved to background, {} kb -> {} kb in {} ms", bytes_before / 1024, mLuaAllocator.getBytes() / 1024,
+		time.count());
+}
+
+void App::LuaHook(lua_State* L, lua_Debug* ar)
+{
+	auto app = *static_cast<App**>(lua_getextraspace(L));
+	app->onLuaHook(L, ar->event);
+}
+
+void App::onLuaHook(lua_State* L, int event)
+{
+	if (mProfiler.isEnabled())
+		mProfiler.onHook(L);
+
+	// returns are hooked only for profiler, watchdog is checked by count
+	if (event != LUA_HOOKCOUNT)
+		return;
+
+	auto now = std::chrono::steady_clock::now();
+	auto deadline = mWatchdogDeadline.value_or(mWatchdogFrameStart + WatchdogFallbackBudget);
+
+	if (now < deadline + (gHostBlockingTime - mWatchdogBlockingTime))
+		return;
+
+	mWatchdogTriggered = true;
+	luaL_traceback(L, L, std::format("frame budget of {} ms exceeded", mOptions.frame_budget_ms).c_str(), 0);
+	lua_error(L);
+}
+
+void App::setProfiling(bool value)
+{
+	mProfiler.setEnabled(value);
+
+	if (!mSolState)
+		return;
+
+	// count hook does not fire inside c functions, so their time is sampled when they return.
+	// Coroutines take hook of their creator, ones created before keep count hook only
+	auto mask = value ? LUA_MASKCOUNT | LUA_MASKRET : LUA_MASKCOUNT;
+	lua_sethook(mSolState->lua_state(), LuaHook, mask, WatchdogHookInstructions);
+}
+
+void App::makeAppApi()
+{
+	mSolState->create_named_table("App",
+		"GCMode", mSolState->create_table_with(
+			"Incremental", AppOptions::GCMode::Incremental,
+			"Generational", AppOptions::GCMode::Generational
+		),
+		"SetGCMode", Bind("App.SetGCMode", [this](int _mode) {
+			auto mode = magic_enum::enum_cast<AppOptions::GCMode>(_mode);
+			setGCMode(mode.value());
+		}),
+		"SetGCBudget", Bind("App.SetGCBudget", [this](int microseconds) {
+			setGCBudget(microseconds);
+		}),
+		"OnFixedUpdate", Bind("App.OnFixedUpdate", [this](sol::protected_function func, float hz) {
+			auto callback = FixedFrameCallback{};
+			callback.id = ++mFrameCallbackId;
+			callback.func = func;
+			callback.step = 1.0f / hz;
+			mFixedUpdateCallbacks.push_back(callback);
+			return callback.id;
+		}),
+		"OnUpdate", Bind("App.OnUpdate", [this](sol::protected_function func) {
+			return subscribe(mUpdateCallbacks, func);
+		}),
+		"OnDraw", Bind("App.OnDraw", [this](sol::protected_function func) {
+			return subscribe(mDrawCallbacks, func);
+		}),
+		"Unsubscribe", Bind("App.Unsubscribe", [this](int id) {
+			unsubscribe(id);
+		})
+	);
+
+	LuaBlob::MakeApi(*mSolState);
+	MakeTypedArrayApi(*mSolState);
+
+	// worker runs until its handle is collected or terminated
+	mSolState->new_usertype<LuaWorkerHandle>("Worker",
+		sol::call_constructor, sol::no_constructor,
+		"Create", Bind("Worker.Create", [this](std::string code, std::optional<std::string> name) {
+			auto worker = std::make_shared<LuaWorker>(gThreadPool, std::move(code), name.value_or("worker"));
+			worker->start();
+			auto handle = std::make_shared<LuaWorkerHandle>(worker);
+			mWorkers.push_back(handle);
+			return handle;
+		}),
+		"Post", Bind("Worker.Post", [](LuaWorkerHandle& self, sol::stack_object value) {
+			self.getWorker()->post(LuaMessage::Serialize(value.lua_state(), value.stack_index()));
+		}),
+		"Terminate", Bind("Worker.Terminate", [](LuaWorkerHandle& self) {
+			self.getWorker()->terminate();
+		}),
+		"MemoryUsage", sol::property(Bind("Worker.MemoryUsage", [](const LuaWorkerHandle& self) {
+			return self.getWorker()->getMemoryUsage();
+		})),
+		"OnMessage", &LuaWorkerHandle::on_message
 	);
+}
 
-	gfx.new_usertype<skygfx::Texture>("Texture",
-		sol::call_constructor, sol::no_constructor//,
-		//"Create", [](size_t memory, size_t size) {
-		//	return std::make_shared<skygfx::Texture>();
-		//}
-	);
+void App::onFrame()
+{
+	// fetch callbacks still run lua in background, so watchdog frame is advanced anyway
+	mWatchdogFrameStart = std::chrono::steady_clock::now();
+	mWatchdogBlockingTime = gHostBlockingTime;
+	mProfiler.restart();
 
-	// glm
+	if (mBackground)
+		return;
 
-	lua.new_usertype<glm::vec2>("Vec2",
-		sol::call_constructor, sol::constructors<glm::vec2(), glm::vec2(float, float)>(),
-		"X", &glm::vec2::x,
-		"Y", &glm::vec2::y
-	);
+	auto total_allocations = mLuaAllocator.getTotalAllocations();
+	STATS->indicator("lua memory", std::format("{} kb (peak {} kb)", mLuaAllocator.getBytes() / 1024,
+		mLuaAllocator.getPeakBytes() / 1024));
+	STATS->indicator("lua blocks", std::to_string(mLuaAllocator.getBlocks()));
+	STATS->indicator("lua allocs", std::format("{}/frame", total_allocations - mPrevTotalAllocations));
+	mPrevTotalAllocations = total_allocations;
+	STATS->indicator("lua workers", std::to_string(mWorkers.size()));
+	STATS->indicator("lua coroutines", std::to_string(mScheduler ? mScheduler->getSuspendedCount() : 0));
+	STATS->indicator("lua watchdog", mSuspended ? "suspended" : std::format("{} overruns", mFrameOverruns));
+	STATS->indicator("lua gc", std::format("{}, {} us/frame, max {} us/s, {} cycles", magic_enum::enum_name(mOptions.gc_mode),
+		mGCStats.frame_time.count(), mGCStats.max_pause.count(), mGCStats.cycles));
+
+#ifdef BUILD_BINDING_STATS
+	// slowest bindings of last frame, full list is in lua_binding_stats
+	auto bindings = LuaBindingStats::GetSorted();
+	std::sort(bindings.begin(), bindings.end(), [](const auto& a, const auto& b) {
+		return a.second.last_frame.time > b.second.last_frame.time;
+	});
+	for (size_t i = 0; i < std::min<size_t>(bindings.size(), 5); i++)
+	{
+		const auto& [name, stats] = bindings[i];
+		STATS->indicator("binding " + name, std::format("{} calls, {} us, {} allocs/frame, {} calls total", stats.last_frame.calls,
+			std::chrono::duration_cast<std::chrono::microseconds>(stats.last_frame.time).count(), stats.last_frame.allocations,
+			stats.total.calls));
+	}
+#endif
 
-	lua.new_usertype<glm::vec3>("Vec3",
-		sol::call_constructor, sol::constructors<glm::vec3(), glm::vec3(float, float, float)>(),
-		"X", &glm::vec3::x,
-		"Y", &glm::vec3::y,
-		"Z", &glm::vec3::z
-	);
+	ImGui::SetNextWindowPos({ 32.0f, getAbsoluteHeight() * 0.5f }, ImGuiCond_Once);
+	ImGui::Begin("Lua");
+	ImGui::Checkbox("Show lua funcs", &mShowLuaFuncs);
+	ImGui::SameLine();
+	ImGui::Checkbox("Show lua profiler", &mShowLuaProfiler);
+	ImGui::SameLine();
+	ImGui::Checkbox("Show lua heap", &mShowLuaHeap);
+	ImGui::SetWindowSize({ 512, 512 }, ImGuiCond_Once);
 
-	lua.new_usertype<glm::vec4>("Vec4",
-		sol::call_constructor, sol::constructors<glm::vec4(), glm::vec4(float, float, float, float)>(),
-		"X", &glm::vec4::x,
-		"Y", &glm::vec4::y,
-		"Z", &glm::vec4::z,
-		"W", &glm::vec4::w
-	);
+	auto flags = ImGuiInputTextFlags_AllowTabInput;
 
-	lua["Fetch"] = [](const std::string& url, std::function<void(size_t memory, size_t size)> callback, std::optional<std::function<void()>> onfail) {
-		DownloadFileToMemory(url, [callback](void* memory, size_t size) {
-			callback((size_t)memory, size);
-		}, onfail.value_or(nullptr));
-	};
+	if (ImGui::InputTextMultiline("Lua", &mLuaCode, { -1, -1 }, flags))
+		setLuaCode(mLuaCode);
 
-	lua["FetchTexture"] = [url_base](std::string url, std::function<void(std::shared_ptr<skygfx::Texture>)> callback) {
-		url = url_base + url;
-		if (CACHE->hasTexture(url))
-		{
-			callback(TEXTURE(url));
-			return;
-		}
-		DownloadFileToMemory(url, [callback, url](void* memory, size_t size) {
-			auto image = Graphics::Image((void*)memory, size);
-			CACHE->loadTexture(image, url);
-			callback(TEXTURE(url));
-		});
-	};
+	ImGui::End();
 
-	// scene
+	if (mShowLuaFuncs && mSolState)
+		drawInspector();
+	else
+		mInspector.clear(); // snapshot keeps values alive, so it is dropped while hidden
 
-	auto scene = lua.create_named_table("Scene");
+	if (mShowLuaProfiler)
+		drawProfiler();
 
-	scene["Root"] = std::static_pointer_cast<Scene::Node>(canvas);
+	if (mShowLuaHeap)
+		drawHeapProfiler();
+}
 
-	scene.new_usertype<Scene::Transform>("Transform",
-		"new", sol::no_constructor,
-		"Size", sol::property(&Scene::Transform::getSize,  sol::resolve<void(const glm::vec2&)>(&Scene::Transform::setSize)),
-		"Width", sol::property(&Scene::Transform::getWidth, &Scene::Transform::setWidth),
-		"Height", sol::property(&Scene::Transform::getHeight, &Scene::Transform::setHeight),
-		"Anchor", sol::property(&Scene::Transform::getAnchor, sol::resolve<void(const glm::vec2&)>(&Scene::Transform::setAnchor)),
-		"Pivot", sol::property(&Scene::Transform::getPivot, sol::resolve<void(const glm::vec2&)>(&Scene::Transform::setPivot)),
-		"Stretch", sol::property(&Scene::Transform::getStretch, sol::resolve<void(const glm::vec2&)>(&Scene::Transform::setStretch)),
-		"Position", sol::property(&Scene::Transform::getPosition, sol::resolve<void(const glm::vec2&)>(&Scene::Transform::setPosition)),
-		"X", sol::property(&Scene::Transform::getX, &Scene::Transform::setX),
-		"Y", sol::property(&Scene::Transform::getY, &Scene::Transform::setY)
-	);
-	scene.new_usertype<Scene::Node>("Node",
-		sol::base_classes, sol::bases<Scene::Transform>(),
-		sol::call_constructor, sol::no_constructor,
-		"Attach", [](std::shared_ptr<Scene::Node> self, std::shared_ptr<Scene::Node> node) {
-			self->attach(node);
-		},
-		"Touchable", sol::property(&Scene::Node::isTouchable, &Scene::Node::setTouchable)
-	);
-	scene.new_usertype<Scene::Color>("Color",
-		sol::call_constructor, sol::no_constructor,
-		"Color", sol::property(&Scene::Color::getColor, sol::resolve<void(const glm::vec4&)>(&Scene::Color::setColor))
-	);
+void App::drawProfiler()
+{
+	ImGui::Begin("Lua profiler", &mShowLuaProfiler);
+	ImGui::SetWindowSize({ 640, 400 }, ImGuiCond_Once);
 
-	auto createEdgeProperty = [](Scene::Rectangle::Edge edge) {
-		return sol::property([edge](const Scene::Rectangle& self) {
-			return self.getEdgeColor(edge)->getColor();
-		}, [edge](Scene::Rectangle& self, const glm::vec4& color) {
-			self.getEdgeColor(edge)->setColor(color);
-		});
-	};
+	auto enabled = mProfiler.isEnabled();
+	if (ImGui::Checkbox("Enabled", &enabled))
+		setProfiling(enabled);
 
-	auto createCornerProperty = [](Scene::Rectangle::Corner corner) {
-		return sol::property([corner](const Scene::Rectangle& self) {
-			return self.getCornerColor(corner)->getColor();
-		}, [corner](Scene::Rectangle& self, const glm::vec4& color) {
-			self.getCornerColor(corner)->setColor(color);
-		});
-	};
+	ImGui::SameLine();
 
-	scene.new_usertype<Scene::Rectangle>("Rectangle",
-		sol::base_classes, sol::bases<Scene::Node, Scene::Transform, Scene::Color>(),
-		sol::call_constructor, sol::no_constructor,
-		"Create", [] {
-			return std::make_shared<Scene::Rectangle>();
-		},
-		"Edge", createEnumTable.template operator()<Scene::Rectangle::Edge>(),
-		"Corner", createEnumTable.template operator()<Scene::Rectangle::Corner>(),
-		"GetEdgeColor", &Scene::Rectangle::getEdgeColor,
-		"GetCornerColor", &Scene::Rectangle::getCornerColor,
-		"Rounding", sol::property(&Scene::Rectangle::getRounding, &Scene::Rectangle::setRounding),
-		"AbsoluteRounding", sol::property(&Scene::Rectangle::isAbsoluteRounding, &Scene::Rectangle::setAbsoluteRounding),
-		"TopColor", createEdgeProperty(Scene::Rectangle::Edge::Top),
-		"BottomColor", createEdgeProperty(Scene::Rectangle::Edge::Bottom),
-		"LeftColor", createEdgeProperty(Scene::Rectangle::Edge::Left),
-		"RightColor", createEdgeProperty(Scene::Rectangle::Edge::Right),
-		"TopLeftColor", createCornerProperty(Scene::Rectangle::Corner::TopLeft),
-		"TopRightColor", createCornerProperty(Scene::Rectangle::Corner::TopRight),
-		"BottomLeftColor", createCornerProperty(Scene::Rectangle::Corner::BottomLeft),
-		"BottomRightColor", createCornerProperty(Scene::Rectangle::Corner::BottomRight)
-	);
+	auto interval = (int)mProfiler.getInterval().count();
+	ImGui::SetNextItemWidth(128.0f);
+	if (ImGui::InputInt("Interval (us)", &interval))
+		mProfiler.setInterval(std::chrono::microseconds(std::max(interval, 1)));
 
-	scene.new_usertype<Scene::Sprite>("Sprite",
-		sol::base_classes, sol::bases<Scene::Node, Scene::Transform, Scene::Color>(),
-		sol::call_constructor, sol::no_constructor,
-		"Create", [] {
-			return std::make_shared<Scene::Sprite>();
-		},
-		"Texture", sol::property(&Scene::Sprite::getTexture, sol::resolve<void(std::shared_ptr<skygfx::Texture>)>(&Scene::Sprite::setTexture))
-	);
+	ImGui::SameLine();
 
-	scene.new_usertype<Scene::Label>("Label",
-		sol::base_classes, sol::bases<Scene::Node, Scene::Transform, Scene::Color>(),
-		sol::call_constructor, sol::no_constructor,
-		"Create", [] {
-			return std::make_shared<Scene::Label>();
-		},
-		"Text", sol::property(&Scene::Label::getText, &Scene::Label::setText),
-		"FontSize", sol::property(&Scene::Label::getFontSize, &Scene::Label::setFontSize),
-		"GetOutlineColor", &Scene::Label::getOutlineColor,
-		"OutlineColor", sol::property([](const Scene::Label& self) {
-			return self.getOutlineColor()->getColor();
-		}, [](Scene::Label& self, const glm::vec4& color) {
-			self.getOutlineColor()->setColor(color);
-		}),
-		"OutlineThickness", sol::property(&Scene::Label::getOutlineThickness, &Scene::Label::setOutlineThickness)
-	);
+	if (ImGui::Button("Clear"))
+		mProfiler.clear();
 
-	auto physics = lua.create_table_with(
-		"EntityType", createEnumTable.template operator()<Shared::PhysHelpers::Entity::Type>(),
-		"EntityShape", createEnumTable.template operator()<Shared::PhysHelpers::Entity::Shape>()
-	);
+	ImGui::SameLine();
 
-	physics.new_usertype<Shared::PhysHelpers::World>("World",
-		sol::base_classes, sol::bases<Scene::Node, Scene::Transform>(),
-		sol::call_constructor, sol::no_constructor,
-		"Create", [] {
-			return std::make_shared<Shared::PhysHelpers::World>();
-		}
-	);
+	if (ImGui::Button("Copy collapsed stacks"))
+		ImGui::SetClipboardText(mProfiler.exportCollapsedStacks().c_str());
 
-	physics.new_usertype<Shared::PhysHelpers::Entity>("Entity",
-		sol::base_classes, sol::bases<Scene::Node, Scene::Transform>(),
-		sol::call_constructor, sol::no_constructor,
-		"Create", [] {
-			return std::make_shared<Shared::PhysHelpers::Entity>();
-		},
-		"Type", sol::property(&Shared::PhysHelpers::Entity::getType, &Shared::PhysHelpers::Entity::setType),
-		"Shape", sol::property(&Shared::PhysHelpers::Entity::getShape, &Shared::PhysHelpers::Entity::setShape)
-	);
+	auto samples = mProfiler.getSampleCount();
+	ImGui::Text("%zu samples", samples);
 
-	scene["Physics"] = physics;
+	if (samples == 0)
+	{
+		ImGui::End();
+		return;
+	}
 
-	scene.new_usertype<StandardButton>("StandardButton",
-		sol::base_classes, sol::bases<Scene::Rectangle, Scene::Node, Scene::Transform, Scene::Color>(),
-		sol::call_constructor, sol::no_constructor,
-		"Create", [] {
-			return std::make_shared<StandardButton>();
-		},
-		"OnClick", sol::property(&StandardButton::getClickCallback, &StandardButton::setClickCallback),
-		"Text", sol::property(
-			[](StandardButton& self) { return self.getLabel()->getText(); },
-			[](StandardButton& self, std::wstring text) { self.getLabel()->setText(text); }
-		),
-		"Label", sol::property([](StandardButton& self) {
-			return std::static_pointer_cast<Scene::Label>(self.getLabel());
-		})
-	);
+	auto percent = [&](size_t value) {
+		return 100.0f * (float)value / (float)samples;
+	};
 
-	// imscene
+	auto table_flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY;
 
-	auto imscene = lua.create_named_table("ImScene",
-		"IsFirstCall", [] {
-			return IMSCENE->isFirstCall();
-		},
-		"SpawnRectangle", [](std::shared_ptr<Scene::Node> holder, std::optional<std::string> key) {
-			return IMSCENE->spawn<Scene::Rectangle>(*holder, key);
-		},
-		"SpawnLabel", [](std::shared_ptr<Scene::Node> holder, std::optional<std::string> key) {
-			return IMSCENE->spawn<Scene::Label>(*holder, key);
-		},
-		"SpawnSprite", [](std::shared_ptr<Scene::Node> holder, std::optional<std::string> key) {
-			return IMSCENE->spawn<Scene::Sprite>(*holder, key);
-		},
-		"IsMouseHovered", [](std::shared_ptr<Scene::Node> node) {
-			return Shared::SceneHelpers::ImScene::IsMouseHovered(*node);
-		},
-		"Tooltip", [](std::shared_ptr<Scene::Node> holder, std::wstring text) {
-			Shared::SceneHelpers::ImScene::Tooltip(*holder, text);
+	if (ImGui::BeginTabBar("Views"))
+	{
+		if (ImGui::BeginTabItem("Functions"))
+		{
+			if (ImGui::BeginTable("Functions", 3, table_flags))
+			{
+				ImGui::TableSetupColumn("Function");
+				ImGui::TableSetupColumn("Self %", ImGuiTableColumnFlags_WidthFixed, 64.0f);
+				ImGui::TableSetupColumn("Total %", ImGuiTableColumnFlags_WidthFixed, 64.0f);
+				ImGui::TableHeadersRow();
+
+				for (const auto& stats : mProfiler.getFunctionStats())
+				{
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					ImGui::TextUnformatted(stats.function.c_str());
+					ImGui::TableNextColumn();
+					ImGui::Text("%.1f", percent(stats.self_samples));
+					ImGui::TableNextColumn();
+					ImGui::Text("%.1f", percent(stats.total_samples));
+				}
+				ImGui::EndTable();
+			}
+			ImGui::EndTabItem();
 		}
-	);
-}
 
-App::App(std::string url_base) :
-	mUrlBase(url_base)
-{
-	setStretch(1.0f);
-	setColor(Graphics::Color::Black);
+		if (ImGui::BeginTabItem("Lines"))
+		{
+			if (ImGui::BeginTable("Lines", 3, table_flags))
+			{
+				ImGui::TableSetupColumn("Function");
+				ImGui::TableSetupColumn("Line", ImGuiTableColumnFlags_WidthFixed, 48.0f);
+				ImGui::TableSetupColumn("Self %", ImGuiTableColumnFlags_WidthFixed, 64.0f);
+				ImGui::TableHeadersRow();
 
-	mCanvas = std::make_shared<App::Canvas>();
-	mCanvas->setStretch(1.0f);
-	mCanvas->setDrawCallback([this] {
-		GRAPHICS->flush();
-		drawCanvas();
-	});
-	attach(mCanvas);
+				for (const auto& stats : mProfiler.getLineStats())
+				{
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					ImGui::TextUnformatted(stats.function.c_str());
+					ImGui::TableNextColumn();
+					ImGui::Text("%d", stats.line);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.1f", percent(stats.self_samples));
+				}
+				ImGui::EndTable();
+			}
+			ImGui::EndTabItem();
+		}
 
-	auto button = std::make_shared<StandardButton>();
-	button->setPosition({ 32.0f, 32.0f });
-	button->setSize({ 96.0f, 32.0f });
-	button->getLabel()->setText(L"EXIT");
-	button->setClickCallback([] {
-		CONSOLE->execute("exit");
-	});
-	attach(button);
-}
+		ImGui::EndTabBar();
+	}
 
-App::~App()
-{
-	mCanvas->clear(); // we need clear childs of canvas before sol state cleared
+	ImGui::End();
 }
 
-static void DisplayTable(const sol::table& tbl, std::string prefix)
+void App::drawHeapProfiler()
 {
-	for (const auto& pair : tbl)
+	ImGui::Begin("Lua heap", &mShowLuaHeap);
+	ImGui::SetWindowSize({ 640, 400 }, ImGuiCond_Once);
+
+	auto enabled = isHeapProfiling();
+	if (ImGui::Checkbox("Enabled", &enabled))
+		setHeapProfiling(enabled);
+
+	ImGui::SameLine();
+
+	auto interval = (int)(mHeapProfiler.getSampleInterval() / 1024);
+	ImGui::SetNextItemWidth(128.0f);
+	if (ImGui::InputInt("Sample interval (kb)", &interval))
+		mHeapProfiler.setSampleInterval((size_t)std::max(interval, 1) * 1024);
+
+	ImGui::SameLine();
+
+	if (ImGui::Button("Snapshot"))
+		takeHeapSnapshot();
+
+	if (!enabled)
 	{
-		std::string name;
+		ImGui::End();
+		return;
+	}
 
-		if (pair.first.get_type() == sol::type::string) {
-			name = pair.first.as<std::string>();
-		}
-		else if (pair.first.get_type() == sol::type::number) {
-			name = std::to_string(pair.first.as<double>());
-		}
-		else {
-			name = " (non-string key)";
-		}
+	// with snapshot, growth since it is shown, which is what leaks and per-frame churn look like
+	auto current = mHeapProfiler.takeSnapshot();
+	auto locations = mHeapSnapshot.has_value() ? LuaHeapProfiler::Diff(mHeapSnapshot.value(), current) : current.locations;
+	auto seconds = mHeapSnapshot.has_value() ? std::chrono::duration<float>(current.time - mHeapSnapshot->time).count() : 0.0f;
 
-		name = prefix + name;
+	if (mHeapSnapshot.has_value())
+		ImGui::Text("since snapshot %.1f s ago", seconds);
 
-		sol::object value = pair.second;
+	auto table_flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY;
 
-		auto drawText = [&](const std::string& text) {
-			ImGui::Text("%s", text.c_str());
-		};
+	if (ImGui::BeginTable("Locations", 3, table_flags))
+	{
+		ImGui::TableSetupColumn("Location");
+		ImGui::TableSetupColumn("Live (kb)", ImGuiTableColumnFlags_WidthFixed, 80.0f);
+		ImGui::TableSetupColumn(seconds > 0.0f ? "Alloc (kb/s)" : "Alloc (kb)", ImGuiTableColumnFlags_WidthFixed, 80.0f);
+		ImGui::TableHeadersRow();
 
-		if (value.get_type() == sol::type::function) {
-			drawText(name + " (function)");
-		}
-		else if (value.get_type() == sol::type::number) {
-			drawText(name + " (number): " + std::to_string(value.as<double>()));
-		}
-		else if (value.get_type() == sol::type::string) {
-			drawText(name + " (string): " + value.as<std::string>());
-		}
-		else if (value.get_type() == sol::type::table) {
-			if (ImGui::TreeNode((name).c_str())) {
-				DisplayTable(value.as<sol::table>(), name + ".");
-				ImGui::TreePop();
-			}
-		}
-		else {
-			drawText(name + " (other)");
+		for (const auto& stats : locations)
+		{
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(stats.location.c_str());
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f", (float)stats.live_bytes / 1024.0f);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f", (float)stats.allocated_bytes / 1024.0f / (seconds > 0.0f ? seconds : 1.0f));
 		}
+		ImGui::EndTable();
 	}
+
+	ImGui::End();
 }
 
-void App::drawCanvas()
+void App::drawInspector()
 {
-	if (!mSolState)
-		return;
+	ImGui::Begin("Lua funcs", &mShowLuaFuncs);
+	ImGui::SetWindowSize({ 640, 480 }, ImGuiCond_Once);
+
+	// auto refresh rescans one table at a time, a few times per second
+	constexpr auto AutoRefreshInterval = std::chrono::milliseconds(250);
+
+	auto now = std::chrono::steady_clock::now();
+
+	if (mInspector.isEmpty())
+	{
+		mInspector.setRoot(mSolState->globals());
+	}
+	else if (mInspectorAutoRefresh && now - mInspectorRefreshTime >= AutoRefreshInterval)
+	{
+		mInspector.refreshNext();
+		mInspectorRefreshTime = now;
+	}
+
+	if (ImGui::Button("Refresh"))
+		mInspector.refresh();
 
-	auto frame = (*mSolState)["Frame"];
+	ImGui::SameLine();
+	ImGui::Checkbox("Auto refresh", &mInspectorAutoRefresh);
+	ImGui::SameLine();
 
-	if (frame.is<sol::function>())
+	auto filter = mInspector.getFilter();
+	ImGui::SetNextItemWidth(-1.0f);
+	if (ImGui::InputTextWithHint("##Filter", "search keys", &filter))
+		mInspector.setFilter(filter);
+
+	const auto& rows = mInspector.getRows();
+	ImGui::Text("%zu rows, %zu tables scanned", rows.size(), mInspector.getScannedTablesCount());
+
+	auto table_flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+	std::optional<std::string> toggled;
+
+	if (ImGui::BeginTable("Globals", 3, table_flags))
 	{
-		auto delta = Clock::ToSeconds(FRAME->getTimeDelta());
-		auto res = frame(delta);
-		if (!res.valid())
+		ImGui::TableSetupScrollFreeze(0, 1);
+		ImGui::TableSetupColumn("Key");
+		ImGui::TableSetupColumn("Type", ImGuiTableColumnFlags_WidthFixed, 64.0f);
+		ImGui::TableSetupColumn("Value");
+		ImGui::TableHeadersRow();
+
+		// only visible rows are drawn, values are formatted on first show
+		ImGuiListClipper clipper;
+		clipper.Begin((int)rows.size());
+
+		while (clipper.Step())
 		{
-			HandleError(res);
-			if (gScratch.isBegan())
+			for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++)
 			{
-				gScratch.end();
+				const auto& row = rows[i];
+				auto indent = (float)row.depth * ImGui::GetStyle().IndentSpacing;
+				auto tree_flags = ImGuiTreeNodeFlags_NoTreePushOnOpen | ImGuiTreeNodeFlags_SpanFullWidth;
+
+				if (!row.expandable)
+					tree_flags |= ImGuiTreeNodeFlags_Leaf;
+
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::PushID(i);
+
+				if (indent > 0.0f)
+					ImGui::Indent(indent);
+
+				ImGui::SetNextItemOpen(row.expanded);
+
+				auto label = mInspector.getFilter().empty() ? row.entry->key.c_str() : row.path.c_str();
+				if (ImGui::TreeNodeEx(label, tree_flags) != row.expanded && row.expandable)
+					toggled = row.path;
+
+				if (indent > 0.0f)
+					ImGui::Unindent(indent);
+
+				ImGui::PopID();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(LuaInspector::GetTypeName(*row.entry));
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(LuaInspector::GetText(*row.entry).c_str());
 			}
 		}
-		try
-		{
-			gScratch.flush();
-		}
-		catch (const std::exception& e)
-		{
-			sky::Log(Console::Color::Red, e.what());
-		}
+
+		ImGui::EndTable();
 	}
-}
 
-void App::onFrame()
-{
-	ImGui::SetNextWindowPos({ 32.0f, getAbsoluteHeight() * 0.5f }, ImGuiCond_Once);
-	ImGui::Begin("Lua");
-	ImGui::Checkbox("Show lua funcs", &mShowLuaFuncs);
-	ImGui::SetWindowSize({ 512, 512 }, ImGuiCond_Once);
+	// applied after drawing, toggling rebuilds rows
+	if (toggled.has_value())
+		mInspector.toggle(toggled.value());
 
-	auto flags = ImGuiInputTextFlags_AllowTabInput;
+	ImGui::End();
+}
 
-	if (ImGui::InputTextMultiline("Lua", &mLuaCode, { -1, -1 }, flags))
-		setLuaCode(mLuaCode);
+void App::setHeapProfiling(bool value)
+{
+	if (value == isHeapProfiling())
+		return;
 
-	ImGui::End();
+	mHeapProfiler.clear();
+	mHeapSnapshot.reset();
+	mLuaAllocator.setListener(value ? &mHeapProfiler : nullptr);
+}
 
-	if (mShowLuaFuncs)
-	{
-		ImGui::Begin("Lua funcs", &mShowLuaFuncs);
-		DisplayTable(mSolState->globals(), "");
-		ImGui::End();
-	}
+void App::takeHeapSnapshot()
+{
+	mHeapSnapshot = mHeapProfiler.takeSnapshot();
 }
 
 void App::setLuaCode(const std::string& lua)
@@ -965,24 +3197,60 @@ void App::setLuaCode(const std::string& lua)
 
 	mCanvas->clear();
 	mCanvas->clearActions();
+	clearFrameCallbacks();
+	mWorkers.clear();
+	mScheduler.reset();
+	mHeapProfiler.setState(nullptr);
+	mInspector.clear();
 	mSolState.reset();
+	mProfiler.clear();
+	mHeapProfiler.clear();
+	mHeapSnapshot.reset();
 
-	mSolState = std::make_unique<sol::state>();
-	mSolState->open_libraries();
-	mSolState->set_panic(HandlePanic);
+	mLuaAllocator.setLimit(std::nullopt);
+	mLuaAllocator.trim();
 
-	MakeApi(*mSolState, mUrlBase, mCanvas);
+	mSolState = std::make_unique<sol::state>(HandlePanic, LuaAllocator::Alloc, &mLuaAllocator);
+	mSolState->open_libraries();
 
+	mScheduler = std::make_unique<LuaScheduler>(mSolState->lua_state(), [](const std::string& error) {
+		sky::Log(Console::Color::Red, "RUNTIME ERROR: {}", error);
+	});
+	mScheduler->makeApi(*mSolState);
+
+	MakeApi(*mSolState, mUrlBase, mCanvas, *mScheduler, mScratch, mOptions.trusted);
+	makeAppApi();
+	applyGCMode();
+	mGCStats = {};
+
+	auto L = mSolState->lua_state();
+	*static_cast<App**>(lua_getextraspace(L)) = this;
+	mHeapProfiler.setState(L);
+	setProfiling(mProfiler.isEnabled());
+	mWatchdogFrameStart = std::chrono::steady_clock::now();
+	mWatchdogBlockingTime = gHostBlockingTime;
+	mFrameOverruns = 0;
+	mSuspended = false;
+
+	// applied after api creation, so limit cannot break bindings setup
+	mLuaAllocator.setLimit(mOptions.memory_limit);
+
+	armWatchdog(std::chrono::milliseconds(mOptions.frame_budget_ms) * 10); // loading usually does more work than frame
 	auto res = mSolState->do_string(lua, "entry-point");
+	disarmWatchdog();
+
+	// entry point gets no host steps, so its garbage is collected before first frame
+	if (mOptions.gc_mode == AppOptions::GCMode::Incremental)
+		collectGarbage();
 
 	if (!res.valid())
-	{
 		HandleError(res);
-	}
-	else
-	{
-		gLuaCodeLoaded = true;
-	}
+}
+
+void App::setMemoryLimit(std::optional<size_t> value)
+{
+	mOptions.memory_limit = value;
+	mLuaAllocator.setLimit(value);
 }
 
 void App::Canvas::draw()
@@ -2,14 +2,43 @@
 
 #include <sky/sky.h>
 #include <sol/sol.hpp>
+#include "lua_allocator.h"
+#include "lua_binding_stats.h"
+#include "lua_heap_profiler.h"
+#include "lua_inspector.h"
+#include "lua_profiler.h"
+#include "lua_scheduler.h"
+#include "lua_typed_array.h"
+#include "lua_worker.h"
+#include "texture_atlas.h"
+#include "texture_cache.h"
+#include "texture_loader.h"
+#include "utf8.h"
 
 namespace skyapp
 {
+	struct AppOptions
+	{
+		enum class GCMode
+		{
+			Incremental, // collector is stepped by host within frame budget, automatic one is stopped
+			Generational // collector runs by itself, host adds minor collections in idle time
+		};
+
+		std::optional<size_t> memory_limit;
+		GCMode gc_mode = GCMode::Incremental;
+		int gc_budget_us = 1000;
+		int frame_budget_ms = 100;
+		int max_frame_overruns = 3; // app is suspended after this many consecutive overruns
+		bool trusted = false; // unchecked fast bindings, only for apps we ship or vet
+	};
+
 	struct ShowcaseApp
 	{
 		std::string name;
 		std::optional<std::string> avatar;
 		std::string entry_point;
+		AppOptions options;
 	};
 
 	class StandardButton : public Shared::SceneHelpers::BouncingButtonBehavior<Shared::SceneHelpers::RectangleButton>
@@ -26,22 +55,117 @@ namespace skyapp
 		class Canvas;
 
 	public:
-		App(std::string url_base);
+		App(std::string url_base, AppOptions options = {});
 		~App();
 
 	private:
 		void drawCanvas();
 		void onFrame() override;
+		void makeAppApi();
+		void applyGCMode();
+		void stepGarbageCollector();
+		void collectGarbage(); // full cycle, backstop of incremental mode
+		void armWatchdog(std::chrono::milliseconds budget);
+		void disarmWatchdog();
+		void onLuaHook(lua_State* L, int event);
+		void setProfiling(bool value);
+
+		static void LuaHook(lua_State* L, lua_Debug* ar);
+
+		struct FrameCallback
+		{
+			int id;
+			sol::protected_function func;
+			bool removed = false; // function cannot be released while it may be running
+		};
+
+		struct FixedFrameCallback : FrameCallback
+		{
+			float step;
+			float accumulator = 0.0f;
+		};
+
+		int subscribe(std::deque<FrameCallback>& callbacks, sol::protected_function func);
+		void unsubscribe(int id);
+		void clearFrameCallbacks();
+		void resolveLegacyFrame();
+		bool callFrameCallback(FrameCallback& callback, float delta);
+		void dispatchWorkerMessages();
+		void drawProfiler();
+		void drawHeapProfiler();
+		void drawInspector();
 
 	public:
 		void setLuaCode(const std::string& lua);
 
+		const auto& getOptions() const { return mOptions; }
+		void setMemoryLimit(std::optional<size_t> value);
+		void setGCMode(AppOptions::GCMode value);
+		void setGCBudget(int value) { mOptions.gc_budget_us = value; }
+		void setFrameBudget(int value) { mOptions.frame_budget_ms = value; }
+
+		bool isSuspended() const { return mSuspended; }
+		void resume();
+
+		// background app keeps its state but gets no frames, memory is compacted when entering background
+		bool isBackground() const { return mBackground; }
+		void setBackground(bool value);
+
+		auto getMemoryUsage() const { return mLuaAllocator.getBytes(); }
+
+		auto& getProfiler() { return mProfiler; }
+		auto& getHeapProfiler() { return mHeapProfiler; }
+
+		bool isHeapProfiling() const { return mLuaAllocator.getListener() != nullptr; }
+		void setHeapProfiling(bool value);
+		void takeHeapSnapshot();
+		const auto& getHeapSnapshot() const { return mHeapSnapshot; }
+
 	private:
 		std::string mUrlBase;
+		AppOptions mOptions;
+		LuaAllocator mLuaAllocator; // must outlive sol state
+		size_t mPrevTotalAllocations = 0;
+
+		struct GCStats
+		{
+			std::chrono::microseconds frame_time = {};
+			std::chrono::microseconds max_pause = {}; // within last second
+			std::chrono::steady_clock::time_point max_pause_start;
+			std::chrono::microseconds minor_estimate = {};
+			size_t cycles = 0;
+			size_t heap_after_cycle = 0;
+		};
+
+		GCStats mGCStats;
+
+		std::optional<std::chrono::steady_clock::time_point> mWatchdogDeadline;
+		std::chrono::steady_clock::time_point mWatchdogFrameStart;
+		std::chrono::steady_clock::duration mWatchdogBlockingTime = {};
+		bool mWatchdogTriggered = false;
+		int mFrameOverruns = 0;
+		bool mSuspended = false;
+		bool mBackground = false;
+		skygfx::utils::Scratch mScratch;
+		LuaProfiler mProfiler;
+		LuaHeapProfiler mHeapProfiler; // must outlive sol state, allocator reports frees to it
+		std::optional<LuaHeapProfiler::Snapshot> mHeapSnapshot;
 		std::unique_ptr<sol::state> mSolState;
+		LuaInspector mInspector; // holds references, must be cleared before sol state
+		std::unique_ptr<LuaScheduler> mScheduler;
+		std::vector<std::weak_ptr<LuaWorkerHandle>> mWorkers;
+		std::deque<FixedFrameCallback> mFixedUpdateCallbacks; // deque keeps references valid when callbacks subscribe
+		std::deque<FrameCallback> mUpdateCallbacks;
+		std::deque<FrameCallback> mDrawCallbacks;
+		std::optional<FrameCallback> mLegacyFrame; // global Frame of apps without draw callbacks
+		int mFrameCallbackId = 0;
 		std::string mLuaCode;
 		std::shared_ptr<Canvas> mCanvas;
 		bool mShowLuaFuncs = false;
+		bool mInspectorAutoRefresh = false;
+		std::chrono::steady_clock::time_point mInspectorRefreshTime;
+		bool mShowLuaProfiler = false;
+		bool mShowLuaHeap = false;
 	};
 
 	class App::Canvas : public Scene::Node
@@ -61,19 +185,30 @@ namespace skyapp
 	{
 	public:
 		Application();
-		~Application() = default;
+		~Application();
 
 	private:
 		void onFrame() override;
 		void drawShowcaseApps();
 		void openShowcase(std::string url, std::function<void()> onFail = nullptr);
 		void openAppPreview(std::string url);
-		void runApp(std::string url);
+		void runApp(std::string url, AppOptions options = {});
+		void showApp(std::shared_ptr<App> app);
+		void hideApp();
+		void closeApp(std::shared_ptr<App> app);
 		std::string makeGithubUrl(const std::string& user, const std::string& repository, const std::string& branch,
 			const std::string& filename);
 
 	private:
 		std::vector<ShowcaseApp> mShowcaseApps;
-		std::shared_ptr<App> mApp;
+
+		struct ResidentApp
+		{
+			std::string url;
+			std::shared_ptr<App> app;
+		};
+
+		std::vector<ResidentApp> mResidentApps; // least recently shown first
+		std::shared_ptr<App> mApp; // foreground app, null when showcase is shown
 	};
 }
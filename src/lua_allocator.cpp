@@ -0,0 +1,224 @@
+#include "lua_allocator.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using namespace skyapp;
+
+static constexpr size_t SizeClassGranularity = 16;
+static constexpr size_t ChunkHeaderSize = SizeClassGranularity; // keeps blocks 16-byte aligned
+
+LuaAllocator::~LuaAllocator()
+{
+	for (auto& pool : mPools)
+	{
+		for (auto chunk : pool.chunks)
+		{
+			::operator delete(chunk, std::align_val_t(ChunkSize));
+		}
+	}
+}
+
+void* LuaAllocator::Alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+	auto self = static_cast<LuaAllocator*>(ud);
+
+	if (nsize == 0)
+	{
+		if (ptr != nullptr)
+		{
+			if (self->mListener != nullptr)
+				self->mListener->onFree(ptr);
+
+			self->deallocate(ptr, osize);
+		}
+
+		return nullptr;
+	}
+
+	// when ptr is null, osize encodes the type of the object being allocated, not a size
+	auto old_size = ptr != nullptr ? osize : 0;
+
+	// lua assumes that shrinking never fails, so the limit is applied only to growth
+	if (self->mLimit.has_value() && nsize > old_size && self->mBytes + (nsize - old_size) > self->mLimit.value())
+		return nullptr;
+
+	if (ptr == nullptr)
+	{
+		auto result = self->allocate(nsize);
+
+		if (result != nullptr && self->mListener != nullptr)
+			self->mListener->onAllocate(result, nsize);
+
+		return result;
+	}
+
+	auto result = self->reallocate(ptr, osize, nsize);
+
+	if (result != nullptr && self->mListener != nullptr)
+		self->mListener->onReallocate(ptr, osize, result, nsize);
+
+	return result;
+}
+
+std::optional<size_t> LuaAllocator::GetSizeClass(size_t size)
+{
+	if (size > MaxPooledSize)
+		return std::nullopt;
+
+	return (size + SizeClassGranularity - 1) / SizeClassGranularity - 1;
+}
+
+LuaAllocator::ChunkHeader* LuaAllocator::GetChunkHeader(void* block)
+{
+	return reinterpret_cast<ChunkHeader*>(reinterpret_cast<uintptr_t>(block) & ~(uintptr_t)(ChunkSize - 1));
+}
+
+void* LuaAllocator::allocate(size_t size)
+{
+	void* result = nullptr;
+
+	if (auto size_class = GetSizeClass(size); size_class.has_value())
+		result = allocateFromPool(size_class.value());
+	else
+		result = std::malloc(size);
+
+	if (result == nullptr)
+		return nullptr;
+
+	mBytes += size;
+	mPeakBytes = std::max(mPeakBytes, mBytes);
+	mBlocks += 1;
+	mTotalAllocations += 1;
+#ifdef BUILD_BINDING_STATS
+	ThreadAllocations += 1;
+#endif
+	return result;
+}
+
+void LuaAllocator::deallocate(void* ptr, size_t size)
+{
+	if (auto size_class = GetSizeClass(size); size_class.has_value())
+		deallocateToPool(ptr, size_class.value());
+	else
+		std::free(ptr);
+
+	mBytes -= size;
+	mBlocks -= 1;
+}
+
+void* LuaAllocator::reallocate(void* ptr, size_t osize, size_t nsize)
+{
+	auto old_class = GetSizeClass(osize);
+	auto new_class = GetSizeClass(nsize);
+
+	if (old_class.has_value() && old_class == new_class)
+	{
+		mBytes = mBytes - osize + nsize;
+		mPeakBytes = std::max(mPeakBytes, mBytes);
+		return ptr;
+	}
+
+	if (!old_class.has_value() && !new_class.has_value())
+	{
+		auto result = std::realloc(ptr, nsize);
+		if (result == nullptr)
+			return nullptr;
+
+		mBytes = mBytes - osize + nsize;
+		mPeakBytes = std::max(mPeakBytes, mBytes);
+		return result;
+	}
+
+	auto result = allocate(nsize);
+	if (result == nullptr)
+		return nullptr;
+
+	std::memcpy(result, ptr, std::min(osize, nsize));
+	deallocate(ptr, osize);
+	mTotalAllocations -= 1; // moving between pools is not a new allocation
+#ifdef BUILD_BINDING_STATS
+	ThreadAllocations -= 1;
+#endif
+	return result;
+}
+
+void* LuaAllocator::allocateFromPool(size_t size_class)
+{
+	auto& pool = mPools[size_class];
+
+	if (pool.free_list == nullptr)
+	{
+		auto chunk = ::operator new(ChunkSize, std::align_val_t(ChunkSize), std::nothrow);
+		if (chunk == nullptr)
+			return nullptr;
+
+		pool.block_size = (size_class + 1) * SizeClassGranularity;
+		pool.chunks.push_back(chunk);
+		mReservedBytes += ChunkSize;
+
+		new (chunk) ChunkHeader{ 0 };
+
+		auto begin = static_cast<uint8_t*>(chunk) + ChunkHeaderSize;
+		auto count = (ChunkSize - ChunkHeaderSize) / pool.block_size;
+
+		for (size_t i = count; i > 0; i--)
+		{
+			auto block = reinterpret_cast<FreeBlock*>(begin + (i - 1) * pool.block_size);
+			block->next = pool.free_list;
+			pool.free_list = block;
+		}
+	}
+
+	auto block = pool.free_list;
+	pool.free_list = block->next;
+	GetChunkHeader(block)->used_blocks += 1;
+	return block;
+}
+
+void LuaAllocator::deallocateToPool(void* ptr, size_t size_class)
+{
+	auto& pool = mPools[size_class];
+	auto block = static_cast<FreeBlock*>(ptr);
+	block->next = pool.free_list;
+	pool.free_list = block;
+	GetChunkHeader(block)->used_blocks -= 1;
+}
+
+void LuaAllocator::trim()
+{
+	for (auto& pool : mPools)
+	{
+		auto is_empty = [](void* chunk) {
+			return static_cast<ChunkHeader*>(chunk)->used_blocks == 0;
+		};
+
+		if (std::none_of(pool.chunks.begin(), pool.chunks.end(), is_empty))
+			continue;
+
+		FreeBlock* free_list = nullptr;
+
+		for (auto block = pool.free_list; block != nullptr;)
+		{
+			auto next = block->next;
+			if (!is_empty(GetChunkHeader(block)))
+			{
+				block->next = free_list;
+				free_list = block;
+			}
+			block = next;
+		}
+
+		pool.free_list = free_list;
+
+		std::erase_if(pool.chunks, [&](void* chunk) {
+			if (!is_empty(chunk))
+				return false;
+
+			::operator delete(chunk, std::align_val_t(ChunkSize));
+			mReservedBytes -= ChunkSize;
+			return true;
+		});
+	}
+}
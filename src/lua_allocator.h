@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <optional>
+#include <vector>
+
+namespace skyapp
+{
+	// lua_Alloc implementation with size-class pools for small blocks,
+	// per-state accounting and optional hard memory limit
+
+	class LuaAllocator
+	{
+	public:
+		// observes blocks of one allocator, called only when set, so profiling costs nothing otherwise
+		class Listener
+		{
+		public:
+			virtual ~Listener() = default;
+			virtual void onAllocate(void* ptr, size_t size) = 0;
+			virtual void onReallocate(void* old_ptr, size_t old_size, void* new_ptr, size_t new_size) = 0;
+			virtual void onFree(void* ptr) = 0;
+		};
+
+	public:
+		static constexpr size_t MaxPooledSize = 256;
+		static constexpr size_t ChunkSize = 64 * 1024;
+
+	public:
+		LuaAllocator() = default;
+		LuaAllocator(const LuaAllocator&) = delete;
+		LuaAllocator& operator=(const LuaAllocator&) = delete;
+		~LuaAllocator();
+
+	public:
+		static void* Alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+
+	public:
+		void trim();
+
+	private:
+		void* allocate(size_t size);
+		void deallocate(void* ptr, size_t size);
+		void* reallocate(void* ptr, size_t osize, size_t nsize);
+
+	private:
+		struct FreeBlock
+		{
+			FreeBlock* next;
+		};
+
+		struct ChunkHeader
+		{
+			size_t used_blocks;
+		};
+
+		struct Pool
+		{
+			size_t block_size = 0;
+			FreeBlock* free_list = nullptr;
+			std::vector<void*> chunks;
+		};
+
+		static std::optional<size_t> GetSizeClass(size_t size);
+		static ChunkHeader* GetChunkHeader(void* block);
+		void* allocateFromPool(size_t size_class);
+		void deallocateToPool(void* ptr, size_t size_class);
+
+	public:
+		auto getBytes() const { return mBytes; }
+		auto getPeakBytes() const { return mPeakBytes; }
+		auto getBlocks() const { return mBlocks; }
+		auto getTotalAllocations() const { return mTotalAllocations; }
+		auto getReservedBytes() const { return mReservedBytes; }
+
+#ifdef BUILD_BINDING_STATS
+		// allocations of all allocators on calling thread, for attributing them to bindings
+		static size_t GetThreadAllocations() { return ThreadAllocations; }
+#endif
+
+		const auto& getLimit() const { return mLimit; }
+		void setLimit(std::optional<size_t> value) { mLimit = value; }
+
+		auto getListener() const { return mListener; }
+		void setListener(Listener* value) { mListener = value; }
+
+	private:
+		std::array<Pool, MaxPooledSize / 16> mPools = {};
+		size_t mBytes = 0;
+		size_t mPeakBytes = 0;
+		size_t mBlocks = 0;
+		size_t mTotalAllocations = 0;
+		size_t mReservedBytes = 0;
+		std::optional<size_t> mLimit;
+		Listener* mListener = nullptr;
+
+#ifdef BUILD_BINDING_STATS
+		static inline thread_local size_t ThreadAllocations = 0;
+#endif
+	};
+}
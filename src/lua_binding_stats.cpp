@@ -0,0 +1,56 @@
+#include "lua_binding_stats.h"
+#include <algorithm>
+
+using namespace skyapp;
+
+#ifdef BUILD_BINDING_STATS
+void BindingStats::record(std::chrono::steady_clock::time_point start, size_t allocations_before)
+{
+	auto time = std::chrono::steady_clock::now() - start;
+	auto allocations = LuaAllocator::GetThreadAllocations() - allocations_before;
+
+	for (auto counters : { &total, &frame })
+	{
+		counters->calls += 1;
+		counters->time += time;
+		counters->allocations += allocations;
+	}
+}
+#endif
+
+BindingStats& LuaBindingStats::Get(const std::string& name)
+{
+	return GetStats()[name];
+}
+
+void LuaBindingStats::NextFrame()
+{
+	for (auto& [name, stats] : GetStats())
+	{
+		stats.last_frame = std::exchange(stats.frame, {});
+	}
+}
+
+void LuaBindingStats::Reset()
+{
+	// entries stay, bindings of running app point to them
+	for (auto& [name, stats] : GetStats())
+	{
+		stats = {};
+	}
+}
+
+std::vector<std::pair<std::string, BindingStats>> LuaBindingStats::GetSorted()
+{
+	auto result = std::vector<std::pair<std::string, BindingStats>>(GetStats().begin(), GetStats().end());
+	std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+		return a.second.total.time > b.second.total.time;
+	});
+	return result;
+}
+
+std::map<std::string, BindingStats>& LuaBindingStats::GetStats()
+{
+	static std::map<std::string, BindingStats> stats;
+	return stats;
+}
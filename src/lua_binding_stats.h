@@ -0,0 +1,164 @@
+#pragma once
+
+#include <sol/sol.hpp>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "lua_allocator.h"
+
+namespace skyapp
+{
+	// per-binding call counters, timing and lua allocations made inside the call.
+	// Bind returns the function unchanged unless BUILD_BINDING_STATS is defined,
+	// so instrumentation costs nothing when compiled out
+
+	struct BindingCounters
+	{
+		size_t calls = 0;
+		std::chrono::nanoseconds time = {};
+		size_t allocations = 0;
+	};
+
+	struct BindingStats
+	{
+		BindingCounters total;
+		BindingCounters frame; // being collected
+		BindingCounters last_frame;
+
+#ifdef BUILD_BINDING_STATS
+		void record(std::chrono::steady_clock::time_point start, size_t allocations_before);
+#endif
+	};
+
+	class LuaBindingStats
+	{
+	public:
+		static BindingStats& Get(const std::string& name);
+		static void NextFrame();
+		static void Reset();
+
+		// sorted by total time, slowest first
+		static std::vector<std::pair<std::string, BindingStats>> GetSorted();
+
+	private:
+		static std::map<std::string, BindingStats>& GetStats(); // node addresses are stable
+	};
+
+#ifdef BUILD_BINDING_STATS
+	namespace detail
+	{
+		template <typename T>
+		struct CallOperatorSignature;
+
+		template <typename R, typename C, typename... Args>
+		struct CallOperatorSignature<R(C::*)(Args...) const> { using Type = R(Args...); };
+
+		template <typename R, typename C, typename... Args>
+		struct CallOperatorSignature<R(C::*)(Args...)> { using Type = R(Args...); };
+
+		template <typename Self, typename C>
+		using SelfOr = std::conditional_t<std::is_void_v<Self>, C, Self>;
+
+		// lambdas
+		template <typename Self, typename T>
+		struct BindingSignature : CallOperatorSignature<decltype(&T::operator())> { };
+
+		template <typename Self, typename R, typename... Args>
+		struct BindingSignature<Self, R(*)(Args...)> { using Type = R(Args...); };
+
+		// member functions take self as first argument, declared as usertype class,
+		// since methods may come from base that is not registered in lua
+		template <typename Self, typename R, typename C, typename... Args>
+		struct BindingSignature<Self, R(C::*)(Args...)> { using Type = R(SelfOr<Self, C>&, Args...); };
+
+		template <typename Self, typename R, typename C, typename... Args>
+		struct BindingSignature<Self, R(C::*)(Args...) const> { using Type = R(const SelfOr<Self, C>&, Args...); };
+
+		template <typename Self, typename R, typename C, typename... Args>
+		struct BindingSignature<Self, R(C::*)(Args...) noexcept> { using Type = R(SelfOr<Self, C>&, Args...); };
+
+		template <typename Self, typename R, typename C, typename... Args>
+		struct BindingSignature<Self, R(C::*)(Args...) const noexcept> { using Type = R(const SelfOr<Self, C>&, Args...); };
+
+		template <typename Sig>
+		struct BindingWrapper;
+
+		// lambda bodies are used instead of raii scope, lua errors may longjmp through them
+		template <typename R, typename... Args>
+		struct BindingWrapper<R(Args...)>
+		{
+			template <typename F>
+			static auto Wrap(BindingStats* stats, F func)
+			{
+				return [stats, func = std::move(func)](Args... args) -> R {
+					auto start = std::chrono::steady_clock::now();
+					auto allocations = LuaAllocator::GetThreadAllocations();
+					if constexpr (std::is_void_v<R>)
+					{
+						std::invoke(func, std::forward<Args>(args)...);
+						stats->record(start, allocations);
+					}
+					else
+					{
+						R result = std::invoke(func, std::forward<Args>(args)...);
+						stats->record(start, allocations);
+						return result;
+					}
+				};
+			}
+		};
+
+		template <lua_CFunction Func>
+		inline BindingStats* CFunctionStats = nullptr;
+
+		template <lua_CFunction Func>
+		int CFunctionWrapper(lua_State* L)
+		{
+			auto start = std::chrono::steady_clock::now();
+			auto allocations = LuaAllocator::GetThreadAllocations();
+			auto result = Func(L);
+			CFunctionStats<Func>->record(start, allocations);
+			return result;
+		}
+	}
+
+	template <typename Self = void, typename F>
+	auto Bind(const std::string& name, F func)
+	{
+		if constexpr (std::is_member_object_pointer_v<F>)
+			return func; // plain fields are accessed by sol directly
+		else
+		{
+			using Signature = typename detail::BindingSignature<Self, F>::Type;
+			return detail::BindingWrapper<Signature>::Wrap(&LuaBindingStats::Get(name), std::move(func));
+		}
+	}
+
+	template <lua_CFunction Func>
+	lua_CFunction BindCFunction(const std::string& name)
+	{
+		detail::CFunctionStats<Func> = &LuaBindingStats::Get(name);
+		return &detail::CFunctionWrapper<Func>;
+	}
+#else
+	template <typename Self = void, typename F>
+	F Bind(const std::string&, F func)
+	{
+		return func;
+	}
+
+	template <lua_CFunction Func>
+	lua_CFunction BindCFunction(const std::string&)
+	{
+		return Func;
+	}
+#endif
+
+	template <typename Self = void, typename Get, typename Set>
+	auto BindProperty(const std::string& name, Get get, Set set)
+	{
+		return sol::property(Bind<Self>(name, std::move(get)), Bind<Self>(name + " =", std::move(set)));
+	}
+}
@@ -0,0 +1,157 @@
+#include "lua_heap_profiler.h"
+#include <algorithm>
+#include <format>
+#include <map>
+
+using namespace skyapp;
+
+static constexpr int MaxStackDepth = 16;
+
+size_t LuaHeapProfiler::LocationKeyHash::operator()(const LocationKey& key) const
+{
+	return std::hash<const void*>()(key.source) ^ (std::hash<int>()(key.line) << 1);
+}
+
+void LuaHeapProfiler::onAllocate(void* ptr, size_t size)
+{
+	mCountdown -= (int64_t)size;
+
+	if (mCountdown > 0 || mState == nullptr)
+		return;
+
+	auto bytes = std::max((int64_t)size, (int64_t)mSampleInterval);
+	mCountdown = (int64_t)mSampleInterval;
+
+	auto location = sampleLocation();
+	mLocations[location].live_bytes += bytes;
+	mLocations[location].allocated_bytes += bytes;
+	mBlocks[ptr] = { location, bytes };
+}
+
+void LuaHeapProfiler::onReallocate(void* old_ptr, size_t old_size, void* new_ptr, size_t new_size)
+{
+	// stack is not walked here, lua may be reallocating the very stack we would walk,
+	// growth is counted and sampled at next fresh allocation instead
+	if (new_size > old_size)
+		mCountdown -= (int64_t)(new_size - old_size);
+
+	if (old_ptr == new_ptr || mBlocks.empty())
+		return;
+
+	auto node = mBlocks.extract(old_ptr);
+
+	if (node.empty())
+		return;
+
+	node.key() = new_ptr;
+	mBlocks.insert(std::move(node));
+}
+
+void LuaHeapProfiler::onFree(void* ptr)
+{
+	if (mBlocks.empty())
+		return;
+
+	auto it = mBlocks.find(ptr);
+
+	if (it == mBlocks.end())
+		return;
+
+	mLocations[it->second.location].live_bytes -= it->second.bytes;
+	mBlocks.erase(it);
+}
+
+uint32_t LuaHeapProfiler::sampleLocation()
+{
+	// nearest lua frame, allocations inside bindings are charged to calling line
+	lua_Debug ar;
+	auto key = LocationKey{ nullptr, 0 };
+	auto found = false;
+
+	for (int level = 0; level < MaxStackDepth && lua_getstack(mState, level, &ar); level++)
+	{
+		lua_getinfo(mState, "Sl", &ar);
+
+		if (ar.currentline < 0)
+			continue;
+
+		key = { ar.source, ar.currentline };
+		found = true;
+		break;
+	}
+
+	if (auto it = mLocationIndices.find(key); it != mLocationIndices.end())
+		return it->second;
+
+	auto index = (uint32_t)mLocations.size();
+	mLocations.push_back({ found ? std::format("{}:{}", ar.short_src, ar.currentline) : "[host]" });
+	mLocationIndices.insert({ key, index });
+	return index;
+}
+
+void LuaHeapProfiler::clear()
+{
+	mLocationIndices.clear();
+	mLocations.clear();
+	mBlocks.clear();
+	mCountdown = (int64_t)mSampleInterval;
+}
+
+LuaHeapProfiler::Snapshot LuaHeapProfiler::takeSnapshot() const
+{
+	// locations are merged by name, so snapshots stay comparable after code reload
+	auto locations = std::map<std::string, LocationStats>();
+
+	for (const auto& stats : mLocations)
+	{
+		auto& dst = locations[stats.location];
+		dst.location = stats.location;
+		dst.live_bytes += stats.live_bytes;
+		dst.allocated_bytes += stats.allocated_bytes;
+	}
+
+	auto result = Snapshot{ std::chrono::steady_clock::now() };
+
+	for (auto& [name, stats] : locations)
+	{
+		result.locations.push_back(std::move(stats));
+	}
+
+	std::sort(result.locations.begin(), result.locations.end(), [](const auto& a, const auto& b) {
+		return a.live_bytes > b.live_bytes;
+	});
+
+	return result;
+}
+
+std::vector<LuaHeapProfiler::LocationStats> LuaHeapProfiler::Diff(const Snapshot& from, const Snapshot& to)
+{
+	auto locations = std::map<std::string, LocationStats>();
+
+	for (const auto& stats : to.locations)
+	{
+		locations[stats.location] = stats;
+	}
+
+	for (const auto& stats : from.locations)
+	{
+		auto& dst = locations[stats.location];
+		dst.location = stats.location;
+		dst.live_bytes -= stats.live_bytes;
+		dst.allocated_bytes -= stats.allocated_bytes;
+	}
+
+	auto result = std::vector<LocationStats>();
+
+	for (auto& [name, stats] : locations)
+	{
+		if (stats.live_bytes != 0 || stats.allocated_bytes != 0)
+			result.push_back(std::move(stats));
+	}
+
+	std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+		return a.live_bytes > b.live_bytes;
+	});
+
+	return result;
+}
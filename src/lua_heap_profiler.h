@@ -0,0 +1,79 @@
+#pragma once
+
+#include <sol/sol.hpp>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "lua_allocator.h"
+
+namespace skyapp
+{
+	// attributes lua heap to source lines. Every sample_interval allocated bytes
+	// one allocation is sampled and charged with the whole interval, so the
+	// stack is walked rarely and big allocations are always caught
+
+	class LuaHeapProfiler : public LuaAllocator::Listener
+	{
+	public:
+		struct LocationStats
+		{
+			std::string location;
+			int64_t live_bytes = 0;
+			int64_t allocated_bytes = 0;
+		};
+
+		struct Snapshot
+		{
+			std::chrono::steady_clock::time_point time;
+			std::vector<LocationStats> locations; // sorted by live bytes, biggest first
+		};
+
+	public:
+		void onAllocate(void* ptr, size_t size) override;
+		void onReallocate(void* old_ptr, size_t old_size, void* new_ptr, size_t new_size) override;
+		void onFree(void* ptr) override;
+
+	public:
+		void clear();
+		Snapshot takeSnapshot() const;
+
+		// per location difference, allocation rate is allocated_bytes divided by time between snapshots
+		static std::vector<LocationStats> Diff(const Snapshot& from, const Snapshot& to);
+
+		void setState(lua_State* L) { mState = L; }
+
+		auto getSampleInterval() const { return mSampleInterval; }
+		void setSampleInterval(size_t value) { mSampleInterval = value; }
+
+	private:
+		uint32_t sampleLocation();
+
+	private:
+		struct LocationKey
+		{
+			const void* source;
+			int line;
+
+			bool operator==(const LocationKey& other) const = default;
+		};
+
+		struct LocationKeyHash
+		{
+			size_t operator()(const LocationKey& key) const;
+		};
+
+		struct SampledBlock
+		{
+			uint32_t location;
+			int64_t bytes;
+		};
+
+		lua_State* mState = nullptr;
+		size_t mSampleInterval = 16 * 1024;
+		int64_t mCountdown = 0;
+		std::unordered_map<LocationKey, uint32_t, LocationKeyHash> mLocationIndices;
+		std::vector<LocationStats> mLocations;
+		std::unordered_map<void*, SampledBlock> mBlocks;
+	};
+}
@@ -0,0 +1,360 @@
+#include "lua_inspector.h"
+#include <algorithm>
+#include <cctype>
+#include <format>
+#include <unordered_map>
+
+using namespace skyapp;
+
+static constexpr size_t MaxStringLength = 128;
+
+static bool ContainsNoCase(std::string_view str, std::string_view needle)
+{
+	auto it = std::search(str.begin(), str.end(), needle.begin(), needle.end(), [](char a, char b) {
+		return std::tolower((unsigned char)a) == std::tolower((unsigned char)b);
+	});
+	return it != str.end();
+}
+
+void LuaInspector::setRoot(sol::table root)
+{
+	clear();
+	auto& table = mTables[""];
+	table.table = root;
+	Scan(root, table.entries);
+}
+
+void LuaInspector::clear()
+{
+	mTables.clear();
+	mRows.clear();
+	mLastRefreshed.clear();
+	mRowsDirty = true;
+}
+
+void LuaInspector::refresh()
+{
+	// rescan may drop children, so paths are collected first
+	auto paths = std::vector<std::string>();
+
+	for (const auto& [path, table] : mTables)
+	{
+		paths.push_back(path);
+	}
+
+	for (const auto& path : paths)
+	{
+		if (auto it = mTables.find(path); it != mTables.end())
+			rescan(it);
+	}
+}
+
+void LuaInspector::refreshNext()
+{
+	if (mTables.empty())
+		return;
+
+	auto it = mTables.upper_bound(mLastRefreshed);
+
+	if (it == mTables.end())
+		it = mTables.begin();
+
+	mLastRefreshed = it->first;
+	rescan(it);
+}
+
+void LuaInspector::toggle(const std::string& path)
+{
+	if (mTables.contains(path))
+	{
+		std::erase_if(mTables, [&](const auto& pair) {
+			const auto& [table_path, table] = pair;
+			return table_path == path || table_path.starts_with(path + ".") || table_path.starts_with(path + "[");
+		});
+		mRowsDirty = true;
+		return;
+	}
+
+	for (const auto& [parent_path, parent] : mTables)
+	{
+		for (const auto& entry : parent.entries)
+		{
+			if (entry.value.get_type() != sol::type::table || MakePath(parent_path, entry.key) != path)
+				continue;
+
+			auto& table = mTables[path];
+			table = { entry.value.as<sol::table>(), {}, parent_path, entry.key };
+			Scan(table.table, table.entries);
+			mRowsDirty = true;
+			return;
+		}
+	}
+}
+
+const std::vector<LuaInspector::Row>& LuaInspector::getRows()
+{
+	if (!mRowsDirty)
+		return mRows;
+
+	mRows.clear();
+	mRowsDirty = false;
+
+	if (mFilter.empty())
+	{
+		appendRows("", 0);
+		return mRows;
+	}
+
+	for (const auto& [table_path, table] : mTables)
+	{
+		for (const auto& entry : table.entries)
+		{
+			auto path = MakePath(table_path, entry.key);
+
+			if (!ContainsNoCase(path, mFilter))
+				continue;
+
+			auto expandable = entry.value.get_type() == sol::type::table;
+			mRows.push_back({ &entry, path, 0, expandable, expandable && mTables.contains(path) });
+		}
+	}
+
+	return mRows;
+}
+
+void LuaInspector::setFilter(std::string value)
+{
+	if (value == mFilter)
+		return;
+
+	mFilter = std::move(value);
+	mRowsDirty = true;
+}
+
+const std::string& LuaInspector::GetText(const Entry& entry)
+{
+	if (entry.text.has_value())
+		return entry.text.value();
+
+	auto L = entry.value.lua_state();
+	entry.value.push(L);
+
+	switch (lua_type(L, -1))
+	{
+	case LUA_TBOOLEAN:
+		entry.text = lua_toboolean(L, -1) ? "true" : "false";
+		break;
+
+	case LUA_TNUMBER:
+		entry.text = lua_isinteger(L, -1) ? std::to_string(lua_tointeger(L, -1)) : std::format("{}", lua_tonumber(L, -1));
+		break;
+
+	case LUA_TSTRING:
+	{
+		size_t size = 0;
+		auto data = lua_tolstring(L, -1, &size);
+		auto str = std::string_view(data, size);
+		auto shown = str.substr(0, std::min(str.find('\n'), MaxStringLength));
+		entry.text = std::format("\"{}\"{}", shown, shown.size() < str.size() ? "..." : "");
+		break;
+	}
+
+	case LUA_TTABLE:
+		entry.text = std::format("{} #{}", lua_topointer(L, -1), lua_rawlen(L, -1));
+		break;
+
+	case LUA_TFUNCTION:
+	{
+		lua_Debug ar;
+		lua_pushvalue(L, -1);
+		lua_getinfo(L, ">S", &ar);
+		entry.text = ar.linedefined > 0 ? std::format("{}:{}", ar.short_src, ar.linedefined) : std::string(ar.short_src);
+		break;
+	}
+
+	case LUA_TUSERDATA:
+		if (luaL_getmetafield(L, -1, "__name") == LUA_TSTRING)
+		{
+			entry.text = lua_tostring(L, -1);
+			lua_pop(L, 1);
+			break;
+		}
+		[[fallthrough]];
+
+	default:
+		entry.text = std::format("{}", lua_topointer(L, -1));
+		break;
+	}
+
+	lua_pop(L, 1);
+	return entry.text.value();
+}
+
+const char* LuaInspector::GetTypeName(const Entry& entry)
+{
+	return lua_typename(entry.value.lua_state(), (int)entry.value.get_type());
+}
+
+bool LuaInspector::Scan(const sol::table& table, std::vector<Entry>& entries)
+{
+	struct Item
+	{
+		std::optional<lua_Number> number;
+		Entry entry;
+		std::optional<size_t> previous; // index of unchanged entry
+	};
+
+	auto L = table.lua_state();
+	auto items = std::vector<Item>();
+	auto previous = std::unordered_map<std::string_view, size_t>();
+	auto changed = false;
+
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		previous.insert({ entries[i].key, i });
+	}
+
+	// raw traversal, inspecting must not run metamethods
+	table.push();
+	lua_pushnil(L);
+
+	while (lua_next(L, -2) != 0)
+	{
+		auto item = Item();
+
+		switch (lua_type(L, -2))
+		{
+		case LUA_TSTRING:
+			item.entry.key = lua_tostring(L, -2);
+			break;
+
+		case LUA_TNUMBER:
+			item.number = lua_tonumber(L, -2);
+			item.entry.key = lua_isinteger(L, -2) ? std::format("[{}]", lua_tointeger(L, -2)) :
+				std::format("[{}]", item.number.value());
+			break;
+
+		case LUA_TBOOLEAN:
+			item.entry.key = lua_toboolean(L, -2) ? "[true]" : "[false]";
+			break;
+
+		default:
+			item.entry.key = std::format("[{} {}]", luaL_typename(L, -2), lua_topointer(L, -2));
+			break;
+		}
+
+		if (auto it = previous.find(item.entry.key); it != previous.end())
+		{
+			entries[it->second].value.push(L);
+
+			if (lua_rawequal(L, -1, -2))
+				item.previous = it->second;
+
+			lua_pop(L, 1);
+		}
+
+		if (item.previous.has_value())
+			lua_pop(L, 1);
+		else
+			item.entry.value = sol::stack::pop<sol::object>(L);
+
+		changed = changed || !item.previous.has_value();
+		items.push_back(std::move(item));
+	}
+
+	lua_pop(L, 1);
+
+	// rows point to entries, so they are kept when nothing changed
+	if (!changed && items.size() == entries.size())
+		return false;
+
+	for (auto& item : items)
+	{
+		if (!item.previous.has_value())
+			continue;
+
+		auto& entry = entries[item.previous.value()];
+		item.entry.value = std::move(entry.value);
+
+		// length of table may have changed
+		if (item.entry.value.get_type() != sol::type::table)
+			item.entry.text = std::move(entry.text);
+	}
+
+	std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+		if (a.number.has_value() != b.number.has_value())
+			return a.number.has_value();
+
+		if (a.number.has_value())
+			return a.number.value() < b.number.value();
+
+		return a.entry.key < b.entry.key;
+	});
+
+	entries.clear();
+	entries.reserve(items.size());
+
+	for (auto& item : items)
+	{
+		entries.push_back(std::move(item.entry));
+	}
+
+	return true;
+}
+
+std::string LuaInspector::MakePath(const std::string& parent, const std::string& key)
+{
+	if (parent.empty() || key.starts_with("["))
+		return parent + key;
+
+	return parent + "." + key;
+}
+
+void LuaInspector::rescan(std::map<std::string, Table>::iterator it)
+{
+	auto& [path, table] = *it;
+
+	if (path.empty())
+	{
+		mRowsDirty = Scan(table.table, table.entries) || mRowsDirty;
+		return;
+	}
+
+	// field may now hold another table or none, parent was rescanned first
+	auto parent = mTables.find(table.parent);
+
+	if (parent != mTables.end())
+	{
+		for (const auto& entry : parent->second.entries)
+		{
+			if (entry.key != table.key || entry.value.get_type() != sol::type::table)
+				continue;
+
+			table.table = entry.value.as<sol::table>();
+			mRowsDirty = Scan(table.table, table.entries) || mRowsDirty;
+			return;
+		}
+	}
+
+	toggle(std::string(path)); // copied, key is erased with its node
+}
+
+void LuaInspector::appendRows(const std::string& path, int depth)
+{
+	auto it = mTables.find(path);
+
+	if (it == mTables.end())
+		return;
+
+	for (const auto& entry : it->second.entries)
+	{
+		auto child_path = MakePath(path, entry.key);
+		auto expandable = entry.value.get_type() == sol::type::table;
+		auto expanded = expandable && mTables.contains(child_path);
+
+		mRows.push_back({ &entry, child_path, depth, expandable, expanded });
+
+		if (expanded)
+			appendRows(child_path, depth + 1);
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <sol/sol.hpp>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace skyapp
+{
+	// cached snapshot of lua tables for debug view. Only root and expanded tables are scanned,
+	// rescans happen on demand or one table per call of refreshNext, values are formatted
+	// when their row is first shown. Unchanged entries keep their references and text across rescans,
+	// rows are rebuilt only when something changed. Snapshot holds references, clear it when view is hidden
+
+	class LuaInspector
+	{
+	public:
+		struct Entry
+		{
+			std::string key; // names are plain, other keys are in brackets
+			sol::object value;
+			mutable std::optional<std::string> text;
+		};
+
+		struct Row
+		{
+			const Entry* entry;
+			std::string path;
+			int depth;
+			bool expandable;
+			bool expanded;
+		};
+
+	public:
+		void setRoot(sol::table root);
+		void clear();
+		bool isEmpty() const { return mTables.empty(); }
+
+		void refresh();
+		void refreshNext(); // rescans one table, round robin
+
+		void toggle(const std::string& path);
+
+		// tree of expanded tables, or flat list of all scanned keys containing filter
+		const std::vector<Row>& getRows();
+		const auto& getFilter() const { return mFilter; }
+		void setFilter(std::string value);
+
+		size_t getScannedTablesCount() const { return mTables.size(); }
+
+		static const std::string& GetText(const Entry& entry);
+		static const char* GetTypeName(const Entry& entry);
+
+	private:
+		struct Table
+		{
+			sol::table table;
+			std::vector<Entry> entries; // sorted, numeric keys first
+			std::string parent;
+			std::string key;
+		};
+
+		static bool Scan(const sol::table& table, std::vector<Entry>& entries); // false when nothing changed
+		static std::string MakePath(const std::string& parent, const std::string& key);
+		void rescan(std::map<std::string, Table>::iterator it);
+		void appendRows(const std::string& path, int depth);
+
+	private:
+		std::map<std::string, Table> mTables; // by path, parents go before children, root is ""
+		std::string mLastRefreshed;
+		std::vector<Row> mRows;
+		bool mRowsDirty = true;
+		std::string mFilter;
+	};
+}
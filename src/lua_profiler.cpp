@@ -0,0 +1,173 @@
+#include "lua_profiler.h"
+#include <algorithm>
+#include <format>
+#include <map>
+
+using namespace skyapp;
+
+static constexpr int MaxStackDepth = 64;
+
+size_t LuaProfiler::FunctionKeyHash::operator()(const FunctionKey& key) const
+{
+	return std::hash<const void*>()(key.id) ^ (std::hash<int>()(key.line_defined) << 1);
+}
+
+size_t LuaProfiler::StackHash::operator()(const std::vector<Frame>& stack) const
+{
+	size_t result = stack.size();
+	for (const auto& frame : stack)
+	{
+		result ^= ((size_t)frame.function << 20 | (size_t)(uint32_t)frame.line) + 0x9e3779b9 + (result << 6) + (result >> 2);
+	}
+	return result;
+}
+
+void LuaProfiler::onHook(lua_State* L)
+{
+	auto now = std::chrono::steady_clock::now();
+	auto weight = (size_t)((now - mLastSample) / mInterval);
+
+	if (weight == 0)
+		return;
+
+	// remainder is kept for next sample, so weights sum up to time spent in lua and its c calls
+	mLastSample += weight * mInterval;
+	mStack.clear();
+
+	lua_Debug ar;
+	for (int level = 0; level < MaxStackDepth && lua_getstack(L, level, &ar); level++)
+	{
+		lua_getinfo(L, "Slf", &ar);
+		auto function = getFunctionIndex(L, ar);
+		lua_pop(L, 1);
+		mStack.push_back({ function, ar.currentline });
+	}
+
+	if (mStack.empty())
+		return;
+
+	mStacks[mStack] += weight;
+	mSampleCount += weight;
+}
+
+uint32_t LuaProfiler::getFunctionIndex(lua_State* L, lua_Debug& ar)
+{
+	auto is_c = ar.what[0] == 'C';
+	auto key = FunctionKey{ is_c ? (const void*)lua_tocfunction(L, -1) : (const void*)ar.source, ar.linedefined };
+
+	if (auto it = mFunctionIndices.find(key); it != mFunctionIndices.end())
+		return it->second;
+
+	// first sample of this function, resolve name once
+	auto name = std::string();
+
+	if (is_c)
+		name = std::format("[C] {}", (const void*)lua_tocfunction(L, -1));
+	else if (ar.what[0] == 'm')
+		name = std::format("{} main chunk", ar.short_src);
+	else
+		name = std::format("{}:{}", ar.short_src, ar.linedefined);
+
+	auto index = (uint32_t)mFunctions.size();
+	mFunctions.push_back(name);
+	mFunctionIndices.insert({ key, index });
+	return index;
+}
+
+void LuaProfiler::setEnabled(bool value)
+{
+	mEnabled = value;
+	restart();
+}
+
+void LuaProfiler::restart()
+{
+	mLastSample = std::chrono::steady_clock::now();
+}
+
+void LuaProfiler::clear()
+{
+	// function keys point into lua state, so they are dropped too
+	mFunctionIndices.clear();
+	mFunctions.clear();
+	mStacks.clear();
+	mSampleCount = 0;
+}
+
+std::vector<LuaProfiler::LineStats> LuaProfiler::getLineStats() const
+{
+	auto lines = std::map<std::pair<uint32_t, int>, size_t>();
+
+	for (const auto& [stack, count] : mStacks)
+	{
+		lines[{ stack.front().function, stack.front().line }] += count;
+	}
+
+	auto result = std::vector<LineStats>();
+	for (const auto& [key, count] : lines)
+	{
+		result.push_back({ mFunctions.at(key.first), key.second, count });
+	}
+
+	std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+		return a.self_samples > b.self_samples;
+	});
+
+	return result;
+}
+
+std::vector<LuaProfiler::FunctionStats> LuaProfiler::getFunctionStats() const
+{
+	auto self_samples = std::vector<size_t>(mFunctions.size());
+	auto total_samples = std::vector<size_t>(mFunctions.size());
+	auto seen = std::vector<uint32_t>();
+
+	for (const auto& [stack, count] : mStacks)
+	{
+		self_samples[stack.front().function] += count;
+
+		// recursive functions are counted once per sample
+		seen.clear();
+		for (const auto& frame : stack)
+		{
+			if (std::find(seen.begin(), seen.end(), frame.function) != seen.end())
+				continue;
+
+			seen.push_back(frame.function);
+			total_samples[frame.function] += count;
+		}
+	}
+
+	auto result = std::vector<FunctionStats>();
+	for (size_t i = 0; i < mFunctions.size(); i++)
+	{
+		if (total_samples[i] > 0)
+			result.push_back({ mFunctions[i], self_samples[i], total_samples[i] });
+	}
+
+	std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+		return a.self_samples > b.self_samples;
+	});
+
+	return result;
+}
+
+std::string LuaProfiler::exportCollapsedStacks() const
+{
+	// one "root;child;leaf count" line per unique stack, as flamegraph.pl and speedscope expect
+	auto result = std::string();
+
+	for (const auto& [stack, count] : mStacks)
+	{
+		for (auto it = stack.rbegin(); it != stack.rend(); ++it)
+		{
+			if (it != stack.rbegin())
+				result += ';';
+
+			result += std::format("{}:{}", mFunctions.at(it->function), it->line);
+		}
+		result += std::format(" {}\n", count);
+	}
+
+	return result;
+}
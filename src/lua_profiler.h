@@ -0,0 +1,88 @@
+#pragma once
+
+#include <sol/sol.hpp>
+#include <chrono>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace skyapp
+{
+	// sampling profiler, samples lua call stack from count and return hooks when interval elapsed.
+	// Sample is weighted by intervals elapsed since previous one, count hook does not fire inside c functions,
+	// so their time is charged to them by return hook. Stacks are stored as frame ids, names are resolved once per function
+
+	class LuaProfiler
+	{
+	public:
+		struct LineStats
+		{
+			std::string function;
+			int line;
+			size_t self_samples;
+		};
+
+		struct FunctionStats
+		{
+			std::string function;
+			size_t self_samples;
+			size_t total_samples;
+		};
+
+	public:
+		void onHook(lua_State* L);
+		void restart(); // when lua is entered, time outside of lua is not sampled
+		void clear();
+
+		std::vector<LineStats> getLineStats() const;
+		std::vector<FunctionStats> getFunctionStats() const;
+		std::string exportCollapsedStacks() const;
+
+		bool isEnabled() const { return mEnabled; }
+		void setEnabled(bool value);
+
+		auto getInterval() const { return mInterval; }
+		void setInterval(std::chrono::microseconds value) { mInterval = value; }
+
+		auto getSampleCount() const { return mSampleCount; }
+
+	private:
+		struct FunctionKey
+		{
+			const void* id; // source of lua function or address of c function
+			int line_defined;
+
+			bool operator==(const FunctionKey& other) const = default;
+		};
+
+		struct FunctionKeyHash
+		{
+			size_t operator()(const FunctionKey& key) const;
+		};
+
+		struct Frame
+		{
+			uint32_t function; // index in mFunctions
+			int line;
+
+			bool operator==(const Frame& other) const = default;
+		};
+
+		struct StackHash
+		{
+			size_t operator()(const std::vector<Frame>& stack) const;
+		};
+
+		uint32_t getFunctionIndex(lua_State* L, lua_Debug& ar);
+
+	private:
+		bool mEnabled = false;
+		std::chrono::microseconds mInterval = std::chrono::microseconds(1000);
+		std::chrono::steady_clock::time_point mLastSample;
+		std::unordered_map<FunctionKey, uint32_t, FunctionKeyHash> mFunctionIndices;
+		std::vector<std::string> mFunctions;
+		std::unordered_map<std::vector<Frame>, size_t, StackHash> mStacks; // leaf frame first
+		std::vector<Frame> mStack;
+		size_t mSampleCount = 0;
+	};
+}
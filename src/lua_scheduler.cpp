@@ -0,0 +1,227 @@
+#include "lua_scheduler.h"
+
+using namespace skyapp;
+
+void LuaFuture::resolve(ResultsPusher results)
+{
+	if (isReady())
+		return;
+
+	mResults = results ? results : [](lua_State*) { return 0; };
+
+	for (auto thread_ref : mWaiters)
+	{
+		mScheduler->mReady.push_back({ thread_ref, shared_from_this() });
+	}
+
+	mWaiters.clear();
+}
+
+LuaScheduler::LuaScheduler(lua_State* L, ErrorCallback errorCallback) :
+	mL(L),
+	mErrorCallback(errorCallback)
+{
+}
+
+void LuaScheduler::update(float delta)
+{
+	mTime += delta;
+
+	while (!mTimers.empty() && mTimers.top().time <= mTime)
+	{
+		auto future = mTimers.top().future;
+		mTimers.pop();
+		future->resolve();
+	}
+
+	// futures created while resuming belong to the next frame
+	auto next_frame = std::move(mNextFrame);
+	mNextFrame.clear();
+
+	for (const auto& future : next_frame)
+	{
+		future->resolve();
+	}
+
+	// resumed coroutines can resolve other futures, so queue can grow while iterating
+	for (size_t i = 0; i < mReady.size(); i++)
+	{
+		auto ready = std::move(mReady[i]);
+		resume(ready.thread_ref, ready.future);
+	}
+
+	mReady.clear();
+}
+
+void LuaScheduler::makeApi(sol::state& lua)
+{
+	lua.new_usertype<LuaFuture>("Future",
+		sol::call_constructor, sol::no_constructor,
+		"IsReady", sol::property(&LuaFuture::isReady)
+	);
+
+	auto L = lua.lua_state();
+
+	auto push_function = [&](const char* name, lua_CFunction func) {
+		lua_pushlightuserdata(L, this);
+		lua_pushcclosure(L, func, 1);
+		lua_setglobal(L, name);
+	};
+
+	push_function("Await", Await);
+	push_function("Sleep", Sleep);
+	push_function("NextFrame", NextFrame);
+
+	lua.create_named_table("Async",
+		"Count", [this] {
+			return getSuspendedCount();
+		}
+	);
+
+	lua_getglobal(L, "Async");
+	lua_pushlightuserdata(L, this);
+	lua_pushcclosure(L, Run, 1);
+	lua_setfield(L, -2, "Run");
+	lua_pop(L, 1);
+}
+
+std::shared_ptr<LuaFuture> LuaScheduler::createFuture()
+{
+	return std::make_shared<LuaFuture>(this);
+}
+
+std::shared_ptr<LuaFuture> LuaScheduler::createTimer(float seconds)
+{
+	auto future = createFuture();
+	mTimers.push({ mTime + seconds, future });
+	return future;
+}
+
+std::shared_ptr<LuaFuture> LuaScheduler::createNextFrame()
+{
+	auto future = createFuture();
+	mNextFrame.push_back(future);
+	return future;
+}
+
+void LuaScheduler::start(lua_State* thread, int thread_ref, int nargs, lua_State* from)
+{
+	// nested Async.Run can happen inside resumed coroutine, keep outer state
+	auto await_registered = mAwaitRegistered;
+	auto running = mRunning;
+	mAwaitRegistered = false;
+	mRunning = thread;
+	int nres = 0;
+	auto status = lua_resume(thread, from, nargs, &nres);
+	mRunning = running;
+	handleResume(thread, thread_ref, status, nres);
+	mAwaitRegistered = await_registered;
+}
+
+void LuaScheduler::resume(int thread_ref, const std::shared_ptr<LuaFuture>& future)
+{
+	lua_rawgeti(mL, LUA_REGISTRYINDEX, thread_ref);
+	auto thread = lua_tothread(mL, -1);
+	lua_pop(mL, 1);
+
+	mSuspendedCount -= 1;
+
+	auto nargs = future->mResults.value()(thread);
+	start(thread, thread_ref, nargs, mL);
+}
+
+void LuaScheduler::handleResume(lua_State* thread, int thread_ref, int status, int nres)
+{
+	if (status == LUA_YIELD)
+	{
+		lua_pop(thread, nres);
+
+		if (mAwaitRegistered)
+		{
+			// Await took its own reference to the thread
+			luaL_unref(mL, LUA_REGISTRYINDEX, thread_ref);
+			return;
+		}
+
+		// plain coroutine.yield inside async task waits for next frame
+		auto future = createNextFrame();
+		future->mWaiters.push_back(thread_ref);
+		mSuspendedCount += 1;
+		return;
+	}
+
+	if (status != LUA_OK)
+	{
+		luaL_traceback(mL, thread, lua_tostring(thread, -1), 0);
+		mErrorCallback(lua_tostring(mL, -1));
+		lua_pop(mL, 1);
+		lua_closethread(thread, mL);
+	}
+
+	luaL_unref(mL, LUA_REGISTRYINDEX, thread_ref);
+}
+
+int LuaScheduler::Run(lua_State* L)
+{
+	auto self = static_cast<LuaScheduler*>(lua_touserdata(L, lua_upvalueindex(1)));
+	luaL_checktype(L, 1, LUA_TFUNCTION);
+
+	auto nargs = lua_gettop(L) - 1;
+	auto thread = lua_newthread(L);
+	lua_pushvalue(L, -1);
+	auto thread_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	lua_insert(L, 1); // keep thread below function and its arguments
+	lua_xmove(L, thread, nargs + 1);
+
+	self->start(thread, thread_ref, nargs, L); // keeps c calls of caller counted
+	return 0;
+}
+
+// lua_yield and lua_error do longjmp, so callers must not keep objects with destructors on stack
+
+int LuaScheduler::Suspend(lua_State* L, LuaFuture* future)
+{
+	auto self = static_cast<LuaScheduler*>(lua_touserdata(L, lua_upvalueindex(1)));
+
+	if (future->isReady())
+		return future->mResults.value()(L);
+
+	if (!lua_isyieldable(L))
+		return luaL_error(L, "can only wait inside Async.Run");
+
+	// coroutine created inside task is resumed by its owner, scheduler must not resume it
+	if (L != self->mRunning)
+		return luaL_error(L, "can only wait in Async.Run task itself, not in coroutine inside it");
+
+	lua_pushthread(L);
+	future->mWaiters.push_back(luaL_ref(L, LUA_REGISTRYINDEX));
+	self->mSuspendedCount += 1;
+	self->mAwaitRegistered = true;
+	return lua_yield(L, 0);
+}
+
+int LuaScheduler::Await(lua_State* L)
+{
+	// future stays alive while it is argument of suspended call
+	auto future = sol::stack::check_get<LuaFuture*>(L, 1);
+
+	if (!future.has_value() || future.value() == nullptr)
+		return lua_gettop(L); // awaiting plain values returns them
+
+	return Suspend(L, future.value());
+}
+
+int LuaScheduler::Sleep(lua_State* L)
+{
+	auto self = static_cast<LuaScheduler*>(lua_touserdata(L, lua_upvalueindex(1)));
+	auto seconds = (float)luaL_checknumber(L, 1);
+	auto future = self->createTimer(seconds).get(); // owned by timers queue
+	return Suspend(L, future);
+}
+
+int LuaScheduler::NextFrame(lua_State* L)
+{
+	auto self = static_cast<LuaScheduler*>(lua_touserdata(L, lua_upvalueindex(1)));
+	auto future = self->createNextFrame().get(); // owned by next frame list
+	return Suspend(L, future);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <sol/sol.hpp>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+
+namespace skyapp
+{
+	class LuaScheduler;
+
+	// result of host operation that lua coroutine can wait for with Await
+
+	class LuaFuture : public std::enable_shared_from_this<LuaFuture>
+	{
+		friend class LuaScheduler;
+
+	public:
+		using ResultsPusher = std::function<int(lua_State*)>; // pushes results, returns their count
+
+	public:
+		LuaFuture(LuaScheduler* scheduler) : mScheduler(scheduler) { }
+
+	public:
+		void resolve(ResultsPusher results = nullptr);
+		bool isReady() const { return mResults.has_value(); }
+
+	private:
+		LuaScheduler* mScheduler;
+		std::optional<ResultsPusher> mResults;
+		std::vector<int> mWaiters; // registry refs of suspended threads
+	};
+
+	// resumes suspended lua coroutines only when their futures are resolved,
+	// so waiting coroutines cost nothing per frame
+
+	class LuaScheduler
+	{
+		friend class LuaFuture;
+
+	public:
+		using ErrorCallback = std::function<void(const std::string&)>;
+
+	public:
+		LuaScheduler(lua_State* L, ErrorCallback errorCallback);
+
+	public:
+		void update(float delta);
+		void makeApi(sol::state& lua);
+		std::shared_ptr<LuaFuture> createFuture();
+		std::shared_ptr<LuaFuture> createTimer(float seconds);
+		std::shared_ptr<LuaFuture> createNextFrame();
+
+		auto getSuspendedCount() const { return mSuspendedCount; }
+
+	private:
+		void start(lua_State* thread, int thread_ref, int nargs, lua_State* from);
+		void resume(int thread_ref, const std::shared_ptr<LuaFuture>& future);
+		void handleResume(lua_State* thread, int thread_ref, int status, int nres);
+
+		static int Run(lua_State* L);
+		static int Await(lua_State* L);
+		static int Sleep(lua_State* L);
+		static int NextFrame(lua_State* L);
+		static int Suspend(lua_State* L, LuaFuture* future);
+
+	private:
+		struct Timer
+		{
+			float time;
+			std::shared_ptr<LuaFuture> future;
+
+			bool operator>(const Timer& other) const { return time > other.time; }
+		};
+
+		struct Ready
+		{
+			int thread_ref;
+			std::shared_ptr<LuaFuture> future;
+		};
+
+		lua_State* mL;
+		ErrorCallback mErrorCallback;
+		float mTime = 0.0f;
+		std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> mTimers;
+		std::vector<std::shared_ptr<LuaFuture>> mNextFrame;
+		std::vector<Ready> mReady;
+		size_t mSuspendedCount = 0;
+		bool mAwaitRegistered = false;
+		lua_State* mRunning = nullptr; // task thread being resumed, only it can wait
+	};
+}
@@ -0,0 +1,252 @@
+#include "lua_typed_array.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+using namespace skyapp;
+
+template <typename T>
+LuaTypedArray<T>::LuaTypedArray(std::shared_ptr<LuaBlob> blob, size_t offset, size_t size) :
+	mBlob(std::move(blob)), mOffset(offset), mSize(size)
+{
+}
+
+template <typename T>
+std::span<T> LuaTypedArray<T>::getSpan() const
+{
+	auto& data = mBlob->getData();
+
+	// without multiplying, so huge size cannot wrap
+	if (mOffset > data.size() || mSize > (data.size() - mOffset) / sizeof(T))
+		return {};
+
+	return { reinterpret_cast<T*>(data.data() + mOffset), mSize };
+}
+
+// sol looks up non-string keys of usertypes through a new registry reference each time,
+// so integer keys are handled before its __index and __newindex, other keys go on to them
+
+template <typename T>
+int LuaTypedArray<T>::Index(lua_State* L)
+{
+	int is_integer = 0;
+	auto index = lua_type(L, 2) == LUA_TNUMBER ? lua_tointegerx(L, 2, &is_integer) : 0; // strings like "3" are not indices
+
+	if (!is_integer)
+	{
+		if (lua_istable(L, lua_upvalueindex(1)))
+		{
+			lua_gettable(L, lua_upvalueindex(1));
+			return 1;
+		}
+
+		lua_pushvalue(L, lua_upvalueindex(1));
+		lua_insert(L, 1);
+		lua_call(L, 2, 1);
+		return 1;
+	}
+
+	auto span = sol::stack::unqualified_get<LuaTypedArray&>(L, 1).getSpan();
+
+	if (index < 1 || index > (lua_Integer)span.size())
+		return luaL_error(L, "index %d is out of bounds", (int)index);
+
+	if constexpr (std::is_floating_point_v<T>)
+		lua_pushnumber(L, (lua_Number)span[index - 1]);
+	else
+		lua_pushinteger(L, (lua_Integer)span[index - 1]);
+
+	return 1;
+}
+
+template <typename T>
+int LuaTypedArray<T>::NewIndex(lua_State* L)
+{
+	int is_integer = 0;
+	auto index = lua_type(L, 2) == LUA_TNUMBER ? lua_tointegerx(L, 2, &is_integer) : 0;
+
+	if (!is_integer)
+	{
+		if (!lua_isfunction(L, lua_upvalueindex(1)))
+			return luaL_error(L, "cannot set field of typed array");
+
+		lua_pushvalue(L, lua_upvalueindex(1));
+		lua_insert(L, 1);
+		lua_call(L, 3, 0);
+		return 0;
+	}
+
+	auto span = sol::stack::unqualified_get<LuaTypedArray&>(L, 1).getSpan();
+
+	if (index < 1 || index > (lua_Integer)span.size())
+		return luaL_error(L, "index %d is out of bounds", (int)index);
+
+	if constexpr (std::is_floating_point_v<T>)
+		span[index - 1] = (T)luaL_checknumber(L, 3);
+	else
+		span[index - 1] = (T)luaL_checkinteger(L, 3);
+
+	return 0;
+}
+
+template <typename T>
+void LuaTypedArray<T>::MakeApi(sol::state& lua, const std::string& name)
+{
+	// lua integers are truncated like in c, floats keep lua numbers
+	using Value = std::conditional_t<std::is_floating_point_v<T>, lua_Number, lua_Integer>;
+
+	auto create = [](size_t size) {
+		if (size > SIZE_MAX / sizeof(T))
+			throw std::out_of_range("size is too large");
+
+		return LuaTypedArray(std::make_shared<LuaBlob>(std::vector<uint8_t>(size * sizeof(T))), 0, size);
+	};
+
+	// 1-based inclusive range like string.sub, to defaults to end
+	auto range = [](const LuaTypedArray& self, std::optional<size_t> from, std::optional<size_t> to) {
+		auto span = self.getSpan();
+		auto first = from.value_or(1);
+		auto last = to.value_or(span.size());
+
+		if (first < 1 || last > span.size() || first > last + 1)
+			throw std::out_of_range("range is out of bounds");
+
+		return span.subspan(first - 1, last - first + 1);
+	};
+
+	lua.new_usertype<LuaTypedArray>(name,
+		sol::call_constructor, sol::no_constructor,
+		"Create", sol::overload(
+			create,
+			[create](const sol::table& values) {
+				auto result = create(values.size());
+				auto span = result.getSpan();
+				for (size_t i = 0; i < span.size(); i++)
+					span[i] = (T)values.raw_get<Value>(i + 1);
+				return result;
+			}
+		),
+		"FromBlob", [](std::shared_ptr<LuaBlob> blob, std::optional<size_t> offset, std::optional<size_t> size) {
+			auto bytes = blob->getData().size();
+			auto first = offset.value_or(0);
+
+			if (first % sizeof(T) != 0 || first > bytes)
+				throw std::out_of_range("offset is out of bounds or misaligned");
+
+			auto count = size.value_or((bytes - first) / sizeof(T));
+
+			if (count > (bytes - first) / sizeof(T))
+				throw std::out_of_range("size is out of bounds");
+
+			return LuaTypedArray(std::move(blob), first, count);
+		},
+		sol::meta_function::length, [](const LuaTypedArray& self) {
+			return self.getSpan().size();
+		},
+		"Size", [](const LuaTypedArray& self) {
+			return self.getSpan().size();
+		},
+		"Blob", [](const LuaTypedArray& self) {
+			return self.getBlob();
+		},
+		// view sharing storage, writes are visible in both
+		"Slice", [range](const LuaTypedArray& self, std::optional<size_t> from, std::optional<size_t> to) {
+			auto span = range(self, from, to);
+			auto offset = self.getOffset() + (size_t)(span.data() - self.getSpan().data()) * sizeof(T);
+			return LuaTypedArray(self.getBlob(), offset, span.size());
+		},
+		"Clone", [create](const LuaTypedArray& self) {
+			auto src = self.getSpan();
+			auto result = create(src.size());
+			std::copy(src.begin(), src.end(), result.getSpan().begin());
+			return result;
+		},
+		"Fill", [range](LuaTypedArray& self, Value value, std::optional<size_t> from, std::optional<size_t> to) {
+			auto span = range(self, from, to);
+			std::fill(span.begin(), span.end(), (T)value);
+		},
+		// source may be a view of same storage, so ranges can overlap
+		"CopyFrom", sol::overload(
+			[](LuaTypedArray& self, const LuaTypedArray& source, std::optional<size_t> at) {
+				auto dst = self.getSpan();
+				auto src = source.getSpan();
+				auto first = at.value_or(1);
+
+				if (first < 1 || src.size() > dst.size() || first - 1 > dst.size() - src.size())
+					throw std::out_of_range("source does not fit");
+
+				std::memmove(dst.data() + first - 1, src.data(), src.size_bytes());
+			},
+			[](LuaTypedArray& self, const sol::table& source, std::optional<size_t> at) {
+				auto dst = self.getSpan();
+				auto size = source.size();
+				auto first = at.value_or(1);
+
+				if (first < 1 || size > dst.size() || first - 1 > dst.size() - size)
+					throw std::out_of_range("source does not fit");
+
+				for (size_t i = 0; i < size; i++)
+					dst[first - 1 + i] = (T)source.raw_get<Value>(i + 1);
+			}
+		),
+		"ToTable", [](const LuaTypedArray& self, sol::this_state L) {
+			auto span = self.getSpan();
+			auto result = sol::table(L, sol::new_table((int)span.size(), 0));
+			for (size_t i = 0; i < span.size(); i++)
+				result.raw_set(i + 1, (Value)span[i]);
+			return result;
+		}
+	);
+
+	auto L = lua.lua_state();
+
+	for (const auto& metatable : { sol::usertype_traits<LuaTypedArray>::metatable(),
+		sol::usertype_traits<LuaTypedArray*>::metatable(), sol::usertype_traits<const LuaTypedArray*>::metatable() })
+	{
+		if (luaL_getmetatable(L, metatable.c_str()) == LUA_TTABLE)
+		{
+			lua_getfield(L, -1, "__index");
+			lua_pushcclosure(L, &Index, 1);
+			lua_setfield(L, -2, "__index");
+			lua_getfield(L, -1, "__newindex");
+			lua_pushcclosure(L, &NewIndex, 1);
+			lua_setfield(L, -2, "__newindex");
+		}
+		lua_pop(L, 1);
+	}
+}
+
+template class skyapp::LuaTypedArray<float>;
+template class skyapp::LuaTypedArray<int32_t>;
+template class skyapp::LuaTypedArray<uint8_t>;
+
+void skyapp::MakeTypedArrayApi(sol::state& lua)
+{
+	LuaFloat32Array::MakeApi(lua, "Float32Array");
+	LuaInt32Array::MakeApi(lua, "Int32Array");
+	LuaUint8Array::MakeApi(lua, "Uint8Array");
+}
+
+std::optional<std::span<uint8_t>> skyapp::GetBufferBytes(lua_State* L, int index)
+{
+	if (lua_type(L, index) != LUA_TUSERDATA)
+		return std::nullopt;
+
+	if (sol::stack::check<LuaBlob>(L, index, sol::no_panic))
+		return std::span(sol::stack::get<LuaBlob&>(L, index).getData());
+
+	auto bytes = [](auto span) {
+		return std::span(reinterpret_cast<uint8_t*>(span.data()), span.size_bytes());
+	};
+
+	if (sol::stack::check<LuaFloat32Array>(L, index, sol::no_panic))
+		return bytes(sol::stack::get<LuaFloat32Array&>(L, index).getSpan());
+
+	if (sol::stack::check<LuaInt32Array>(L, index, sol::no_panic))
+		return bytes(sol::stack::get<LuaInt32Array&>(L, index).getSpan());
+
+	if (sol::stack::check<LuaUint8Array>(L, index, sol::no_panic))
+		return bytes(sol::stack::get<LuaUint8Array&>(L, index).getSpan());
+
+	return std::nullopt;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <sol/sol.hpp>
+#include <span>
+#include "lua_worker.h"
+
+namespace skyapp
+{
+	// contiguous numeric storage for lua, a typed view over blob bytes.
+	// Slices share the blob, so bulk data moves between lua and c++ as one pointer.
+	// Blob may be emptied by posting it to worker, views are checked against its current size
+
+	template <typename T>
+	class LuaTypedArray
+	{
+	public:
+		LuaTypedArray(std::shared_ptr<LuaBlob> blob, size_t offset, size_t size);
+
+	public:
+		static void MakeApi(sol::state& lua, const std::string& name);
+
+	public:
+		std::span<T> getSpan() const;
+
+		const auto& getBlob() const { return mBlob; }
+		auto getOffset() const { return mOffset; }
+
+	private:
+		static int Index(lua_State* L);
+		static int NewIndex(lua_State* L);
+
+	private:
+		std::shared_ptr<LuaBlob> mBlob;
+		size_t mOffset; // in bytes, multiple of sizeof(T)
+		size_t mSize; // in elements
+	};
+
+	using LuaFloat32Array = LuaTypedArray<float>;
+	using LuaInt32Array = LuaTypedArray<int32_t>;
+	using LuaUint8Array = LuaTypedArray<uint8_t>;
+
+	// Float32Array, Int32Array and Uint8Array
+	void MakeTypedArrayApi(sol::state& lua);
+
+	// raw bytes of blob or any typed array, for bindings that take bulk data, nullopt for other values
+	std::optional<std::span<uint8_t>> GetBufferBytes(lua_State* L, int index);
+}
@@ -0,0 +1,395 @@
+#include "lua_worker.h"
+#include "lua_typed_array.h"
+#include <cstring>
+#include <format>
+#include <unordered_map>
+
+using namespace skyapp;
+
+namespace
+{
+	enum class Tag : uint8_t
+	{
+		Nil,
+		False,
+		True,
+		Integer,
+		Number,
+		String,
+		Table,
+		TableEnd,
+		Blob
+	};
+
+	constexpr int MaxDepth = 64;
+
+	void WriteVarint(std::vector<uint8_t>& data, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			data.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		data.push_back((uint8_t)value);
+	}
+
+	uint64_t ReadVarint(const uint8_t*& ptr)
+	{
+		uint64_t result = 0;
+		int shift = 0;
+		while (*ptr & 0x80)
+		{
+			result |= (uint64_t)(*ptr++ & 0x7F) << shift;
+			shift += 7;
+		}
+		result |= (uint64_t)(*ptr++) << shift;
+		return result;
+	}
+
+	// blobs are moved to message only after whole value is written, so failed send leaves them intact.
+	// Blob referenced several times is moved once
+	struct Blobs
+	{
+		std::unordered_map<const LuaBlob*, size_t> indices;
+		std::vector<LuaBlob*> list;
+	};
+
+	void Write(LuaMessage& message, Blobs& blobs, lua_State* L, int index, int depth)
+	{
+		auto& data = message.data;
+		index = lua_absindex(L, index);
+
+		switch (lua_type(L, index))
+		{
+		case LUA_TNIL:
+			data.push_back((uint8_t)Tag::Nil);
+			break;
+
+		case LUA_TBOOLEAN:
+			data.push_back((uint8_t)(lua_toboolean(L, index) ? Tag::True : Tag::False));
+			break;
+
+		case LUA_TNUMBER:
+			if (lua_isinteger(L, index))
+			{
+				auto value = (int64_t)lua_tointeger(L, index);
+				data.push_back((uint8_t)Tag::Integer);
+				WriteVarint(data, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63)); // zigzag, small negatives stay short
+			}
+			else
+			{
+				auto value = (double)lua_tonumber(L, index);
+				data.push_back((uint8_t)Tag::Number);
+				auto bytes = reinterpret_cast<const uint8_t*>(&value);
+				data.insert(data.end(), bytes, bytes + sizeof(value));
+			}
+			break;
+
+		case LUA_TSTRING:
+		{
+			size_t size = 0;
+			auto str = lua_tolstring(L, index, &size);
+			data.push_back((uint8_t)Tag::String);
+			WriteVarint(data, size);
+			data.insert(data.end(), str, str + size);
+			break;
+		}
+
+		case LUA_TTABLE:
+			if (depth >= MaxDepth)
+				throw std::runtime_error("message is too deep or has cycles");
+
+			// key and value of lua_next, and metatable of blob check, only LUA_MINSTACK slots are guaranteed
+			if (!lua_checkstack(L, 3))
+				throw std::runtime_error("message is too deep");
+
+			data.push_back((uint8_t)Tag::Table);
+			lua_pushnil(L);
+			while (lua_next(L, index) != 0)
+			{
+				Write(message, blobs, L, -2, depth + 1);
+				Write(message, blobs, L, -1, depth + 1);
+				lua_pop(L, 1);
+			}
+			data.push_back((uint8_t)Tag::TableEnd);
+			break;
+
+		case LUA_TUSERDATA:
+			if (sol::stack::check<LuaBlob>(L, index, sol::no_panic))
+			{
+				// storage is moved to message, sender's blob becomes empty
+				auto& blob = sol::stack::get<LuaBlob&>(L, index);
+				auto [it, inserted] = blobs.indices.insert({ &blob, blobs.list.size() });
+				data.push_back((uint8_t)Tag::Blob);
+				WriteVarint(data, it->second);
+				if (inserted)
+					blobs.list.push_back(&blob);
+				break;
+			}
+			[[fallthrough]];
+
+		default:
+			throw std::runtime_error(std::string("cannot send value of type ") + luaL_typename(L, index));
+		}
+	}
+
+	void Read(const LuaMessage& message, lua_State* L, const uint8_t*& ptr)
+	{
+		auto tag = (Tag)*ptr++;
+
+		switch (tag)
+		{
+		case Tag::Nil:
+			lua_pushnil(L);
+			break;
+
+		case Tag::False:
+		case Tag::True:
+			lua_pushboolean(L, tag == Tag::True);
+			break;
+
+		case Tag::Integer:
+		{
+			auto value = ReadVarint(ptr);
+			lua_pushinteger(L, (lua_Integer)((value >> 1) ^ (~(value & 1) + 1)));
+			break;
+		}
+
+		case Tag::Number:
+		{
+			double value;
+			std::memcpy(&value, ptr, sizeof(value));
+			ptr += sizeof(value);
+			lua_pushnumber(L, (lua_Number)value);
+			break;
+		}
+
+		case Tag::String:
+		{
+			auto size = (size_t)ReadVarint(ptr);
+			lua_pushlstring(L, (const char*)ptr, size);
+			ptr += size;
+			break;
+		}
+
+		case Tag::Table:
+			// table, key and value, nesting is limited by sender
+			if (!lua_checkstack(L, 3))
+				throw std::runtime_error("message is too deep");
+
+			lua_newtable(L);
+			while ((Tag)*ptr != Tag::TableEnd)
+			{
+				Read(message, L, ptr);
+				Read(message, L, ptr);
+				lua_rawset(L, -3);
+			}
+			ptr++;
+			break;
+
+		case Tag::Blob:
+			sol::stack::push(L, message.blobs.at(ReadVarint(ptr)));
+			break;
+
+		default:
+			lua_pushnil(L);
+			break;
+		}
+	}
+}
+
+void LuaBlob::MakeApi(sol::state& lua)
+{
+	lua.new_usertype<LuaBlob>("Blob",
+		sol::call_constructor, sol::no_constructor,
+		"Create", sol::overload(
+			[](size_t size) {
+				return std::make_shared<LuaBlob>(std::vector<uint8_t>(size));
+			},
+			[](std::string_view str) {
+				return std::make_shared<LuaBlob>(std::vector<uint8_t>(str.begin(), str.end()));
+			}
+		),
+		"Size", [](const LuaBlob& self) {
+			return self.getData().size();
+		},
+		"Get", [](const LuaBlob& self, size_t index) {
+			return self.getData().at(index - 1);
+		},
+		"Set", [](LuaBlob& self, size_t index, uint8_t value) {
+			self.getData().at(index - 1) = value;
+		},
+		"ToString", [](const LuaBlob& self) {
+			return std::string_view((const char*)self.getData().data(), self.getData().size());
+		}
+	);
+}
+
+LuaMessage LuaMessage::Serialize(lua_State* L, int index)
+{
+	LuaMessage message;
+	Blobs blobs;
+	Write(message, blobs, L, index, 0);
+
+	for (auto blob : blobs.list)
+		message.blobs.push_back(std::make_shared<LuaBlob>(std::move(blob->getData())));
+
+	return message;
+}
+
+void LuaMessage::push(lua_State* L) const
+{
+	auto ptr = data.data();
+	Read(*this, L, ptr);
+}
+
+LuaWorker::LuaWorker(ThreadPool& pool, std::string code, std::string name) :
+	mPool(pool),
+	mCode(std::move(code)),
+	mName(std::move(name))
+{
+}
+
+void LuaWorker::start()
+{
+	std::unique_lock lock(mMutex);
+	schedule();
+}
+
+void LuaWorker::post(LuaMessage message)
+{
+	std::unique_lock lock(mMutex);
+	mInbox.push_back(std::move(message));
+	schedule();
+}
+
+void LuaWorker::terminate()
+{
+	mTerminated = true;
+}
+
+std::vector<LuaMessage> LuaWorker::takeMessages()
+{
+	std::unique_lock lock(mMutex);
+	return std::exchange(mOutbox, {});
+}
+
+std::vector<std::string> LuaWorker::takeErrors()
+{
+	std::unique_lock lock(mMutex);
+	return std::exchange(mErrors, {});
+}
+
+void LuaWorker::schedule()
+{
+	// must be called with locked mutex, worker state is used by one thread at a time
+	if (mScheduled || mTerminated)
+		return;
+
+	mScheduled = true;
+	mPool.execute([self = shared_from_this()] {
+		self->process();
+	});
+}
+
+void LuaWorker::process()
+{
+	if (!mState && !mTerminated)
+		initialize();
+
+	auto inbox = std::vector<LuaMessage>();
+
+	{
+		std::unique_lock lock(mMutex);
+		std::swap(inbox, mInbox);
+	}
+
+	for (const auto& message : inbox)
+	{
+		if (mTerminated)
+			break;
+
+		auto on_message = (*mState)["OnMessage"].get<sol::optional<sol::protected_function>>();
+		if (!on_message.has_value())
+			continue;
+
+		message.push(mState->lua_state());
+		auto value = sol::stack::pop<sol::object>(mState->lua_state());
+		auto res = on_message.value()(value);
+		if (!res.valid())
+			reportError(res.get<sol::error>().what());
+	}
+
+	mMemoryUsage = mAllocator.getBytes();
+
+	std::unique_lock lock(mMutex);
+	mScheduled = false;
+
+	if (mTerminated)
+	{
+		mInbox.clear();
+		lock.unlock();
+		mState.reset();
+		return;
+	}
+
+	if (!mInbox.empty())
+		schedule();
+}
+
+void LuaWorker::initialize()
+{
+	mState = std::make_unique<sol::state>(sol::default_at_panic, LuaAllocator::Alloc, &mAllocator);
+	mState->open_libraries(sol::lib::base, sol::lib::string, sol::lib::table, sol::lib::math,
+		sol::lib::coroutine, sol::lib::utf8);
+
+	LuaBlob::MakeApi(*mState);
+	MakeTypedArrayApi(*mState);
+
+	(*mState)["Post"] = [this](sol::stack_object value) {
+		auto message = LuaMessage::Serialize(value.lua_state(), value.stack_index());
+		std::unique_lock lock(mMutex);
+		mOutbox.push_back(std::move(message));
+	};
+
+	auto L = mState->lua_state();
+	*static_cast<LuaWorker**>(lua_getextraspace(L)) = this;
+	lua_sethook(L, TerminateHook, LUA_MASKCOUNT, 10000);
+
+	auto res = mState->safe_script(mCode, sol::script_pass_on_error, mName);
+	if (!res.valid())
+		reportError(res.get<sol::error>().what());
+}
+
+void LuaWorker::reportError(const std::string& error)
+{
+	std::unique_lock lock(mMutex);
+	mErrors.push_back(error);
+}
+
+void LuaWorker::TerminateHook(lua_State* L, lua_Debug* ar)
+{
+	auto self = *static_cast<LuaWorker**>(lua_getextraspace(L));
+	if (self->mTerminated)
+		luaL_error(L, "worker terminated");
+}
+
+void LuaWorkerHandle::dispatch(lua_State* L, const std::function<void(const std::string&)>& errorCallback)
+{
+	for (const auto& error : mWorker->takeErrors())
+	{
+		errorCallback(std::format("worker {}: {}", mWorker->getName(), error));
+	}
+
+	for (const auto& message : mWorker->takeMessages())
+	{
+		if (!on_message.valid())
+			continue;
+
+		message.push(L);
+		auto value = sol::stack::pop<sol::object>(L);
+		auto res = on_message(value);
+		if (!res.valid())
+			errorCallback(res.get<sol::error>().what());
+	}
+}
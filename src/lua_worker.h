@@ -0,0 +1,101 @@
+#pragma once
+
+#include <sol/sol.hpp>
+#include <atomic>
+#include "lua_allocator.h"
+#include "thread_pool.h"
+
+namespace skyapp
+{
+	// binary payload, moved between lua states without copying
+
+	class LuaBlob
+	{
+	public:
+		LuaBlob() = default;
+		LuaBlob(std::vector<uint8_t> data) : mData(std::move(data)) { }
+
+	public:
+		static void MakeApi(sol::state& lua);
+
+	public:
+		auto& getData() { return mData; }
+		const auto& getData() const { return mData; }
+
+	private:
+		std::vector<uint8_t> mData;
+	};
+
+	// compact serialized lua value, blobs are transferred by moving their storage
+
+	struct LuaMessage
+	{
+		std::vector<uint8_t> data;
+		std::vector<std::shared_ptr<LuaBlob>> blobs;
+
+		static LuaMessage Serialize(lua_State* L, int index); // throws on unsupported values
+		void push(lua_State* L) const;
+	};
+
+	// lua state running on thread pool, processes messages one by one
+
+	class LuaWorker : public std::enable_shared_from_this<LuaWorker>
+	{
+	public:
+		LuaWorker(ThreadPool& pool, std::string code, std::string name);
+
+	public:
+		void start();
+		void post(LuaMessage message);
+		void terminate();
+
+		// main thread side
+		std::vector<LuaMessage> takeMessages();
+		std::vector<std::string> takeErrors();
+
+		const auto& getName() const { return mName; }
+		auto getMemoryUsage() const { return mMemoryUsage.load(); }
+
+	private:
+		void schedule();
+		void process();
+		void initialize();
+		void reportError(const std::string& error);
+
+		static void TerminateHook(lua_State* L, lua_Debug* ar);
+
+	private:
+		ThreadPool& mPool;
+		std::string mCode;
+		std::string mName;
+		LuaAllocator mAllocator; // must outlive sol state
+		std::unique_ptr<sol::state> mState;
+		std::mutex mMutex;
+		std::vector<LuaMessage> mInbox;
+		std::vector<LuaMessage> mOutbox;
+		std::vector<std::string> mErrors;
+		bool mScheduled = false;
+		std::atomic<bool> mTerminated = false;
+		std::atomic<size_t> mMemoryUsage = 0;
+	};
+
+	// main state side of worker, delivers its messages to OnMessage callback
+
+	class LuaWorkerHandle
+	{
+	public:
+		LuaWorkerHandle(std::shared_ptr<LuaWorker> worker) : mWorker(worker) { }
+		~LuaWorkerHandle() { mWorker->terminate(); }
+
+	public:
+		void dispatch(lua_State* L, const std::function<void(const std::string&)>& errorCallback);
+
+		const auto& getWorker() const { return mWorker; }
+
+	public:
+		sol::protected_function on_message;
+
+	private:
+		std::shared_ptr<LuaWorker> mWorker;
+	};
+}
@@ -0,0 +1,270 @@
+#include "texture_atlas.h"
+#include <algorithm>
+
+using namespace skyapp;
+
+static constexpr uint32_t Padding = 1; // edge pixels are repeated into it, so linear filtering does not bleed
+
+TextureAtlas::TextureAtlas(uint32_t page_size, uint32_t max_image_size) :
+	mPageSize(page_size), mMaxImageSize(max_image_size)
+{
+}
+
+std::shared_ptr<TextureAtlas::Region> TextureAtlas::insert(const std::string& key, const Graphics::Image& image)
+{
+	if (auto it = mImages.find(key); it != mImages.end())
+		return it->second.region;
+
+	auto width = (uint32_t)image.getWidth();
+	auto height = (uint32_t)image.getHeight();
+
+	if (width > mMaxImageSize || height > mMaxImageSize || width + Padding * 2 > mPageSize ||
+		height + Padding * 2 > mPageSize)
+		return nullptr;
+
+	auto src = static_cast<const uint8_t*>(image.getMemory());
+	auto pixels = std::vector<uint8_t>(src, src + (size_t)width * height * 4);
+
+	auto& entry = mImages[key];
+	entry = { width, height, std::move(pixels), 0, std::make_shared<Region>() };
+
+	if (tryPlace(entry))
+		return entry.region;
+
+	auto freed_area = size_t(0);
+
+	for (const auto& page : mPages)
+	{
+		freed_area += page.freed_area;
+	}
+
+	// holes left by removed images are reused before atlas grows
+	if (freed_area >= (size_t)mPageSize * mPageSize / 4)
+	{
+		repack();
+		return entry.region;
+	}
+
+	addPage();
+	tryPlace(entry);
+	return entry.region;
+}
+
+std::shared_ptr<TextureAtlas::Region> TextureAtlas::find(const std::string& key) const
+{
+	auto it = mImages.find(key);
+	return it != mImages.end() ? it->second.region : nullptr;
+}
+
+void TextureAtlas::remove(const std::string& key)
+{
+	auto it = mImages.find(key);
+
+	if (it == mImages.end())
+		return;
+
+	auto& image = it->second;
+	auto& page = mPages.at(image.page);
+	page.images_count -= 1;
+	page.freed_area += (size_t)(image.width + Padding * 2) * (image.height + Padding * 2);
+	mImages.erase(it);
+
+	// texture is released, sprites may still draw old one
+	if (page.images_count == 0)
+		page = Page();
+}
+
+void TextureAtlas::repack()
+{
+	auto images = std::vector<Image*>();
+
+	for (auto& [key, image] : mImages)
+	{
+		images.push_back(&image);
+	}
+
+	std::sort(images.begin(), images.end(), [](const Image* a, const Image* b) {
+		return a->height != b->height ? a->height > b->height : a->width > b->width;
+	});
+
+	mPages.clear();
+
+	for (auto image : images)
+	{
+		if (tryPlace(*image))
+			continue;
+
+		addPage();
+		tryPlace(*image);
+	}
+}
+
+size_t TextureAtlas::getBytes() const
+{
+	auto bytes = size_t(0);
+
+	for (const auto& page : mPages)
+	{
+		if (page.texture)
+			bytes += (size_t)mPageSize * mPageSize * 4;
+	}
+
+	return bytes;
+}
+
+std::shared_ptr<TextureAtlas::Region> TextureAtlas::MakeRegion(std::shared_ptr<skygfx::Texture> texture)
+{
+	auto region = std::make_shared<Region>();
+	region->tex_region.pos = { 0.0f, 0.0f };
+	region->tex_region.size = { (float)texture->getWidth(), (float)texture->getHeight() };
+	region->uv = { 0.0f, 0.0f, 1.0f, 1.0f };
+	region->texture = std::move(texture);
+	return region;
+}
+
+// bottom-left rule, lowest top edge wins, then narrowest segment
+
+std::optional<glm::uvec2> TextureAtlas::findPosition(const Page& page, uint32_t width, uint32_t height, size_t& segment) const
+{
+	auto result = std::optional<glm::uvec2>();
+	auto best_y = mPageSize;
+	auto best_width = mPageSize;
+	const auto& skyline = page.skyline;
+
+	for (size_t i = 0; i < skyline.size(); i++)
+	{
+		auto x = skyline[i].x;
+
+		if (x + width > mPageSize)
+			break;
+
+		auto y = uint32_t(0);
+		auto remaining = width;
+
+		for (size_t j = i; remaining > 0; j++)
+		{
+			y = std::max(y, skyline[j].y);
+			remaining -= std::min(remaining, skyline[j].width);
+		}
+
+		if (y + height > mPageSize)
+			continue;
+
+		if (y < best_y || (y == best_y && skyline[i].width < best_width))
+		{
+			best_y = y;
+			best_width = skyline[i].width;
+			segment = i;
+			result = glm::uvec2{ x, y };
+		}
+	}
+
+	return result;
+}
+
+void TextureAtlas::place(Page& page, size_t segment, glm::uvec2 pos, uint32_t width, uint32_t height)
+{
+	auto& skyline = page.skyline;
+	skyline.insert(skyline.begin() + segment, { pos.x, pos.y + height, width });
+
+	// segments under new one are cut off
+	for (size_t i = segment + 1; i < skyline.size();)
+	{
+		auto end = skyline[i - 1].x + skyline[i - 1].width;
+
+		if (skyline[i].x >= end)
+			break;
+
+		auto shrink = end - skyline[i].x;
+
+		if (skyline[i].width <= shrink)
+		{
+			skyline.erase(skyline.begin() + i);
+			continue;
+		}
+
+		skyline[i].x += shrink;
+		skyline[i].width -= shrink;
+		break;
+	}
+
+	for (size_t i = 0; i + 1 < skyline.size();)
+	{
+		if (skyline[i].y != skyline[i + 1].y)
+		{
+			i++;
+			continue;
+		}
+
+		skyline[i].width += skyline[i + 1].width;
+		skyline.erase(skyline.begin() + i + 1);
+	}
+}
+
+bool TextureAtlas::tryPlace(Image& image)
+{
+	auto width = image.width + Padding * 2;
+	auto height = image.height + Padding * 2;
+
+	for (size_t i = 0; i < mPages.size(); i++)
+	{
+		if (!mPages[i].texture)
+			mPages[i] = makePage();
+
+		auto segment = size_t(0);
+		auto pos = findPosition(mPages[i], width, height, segment);
+
+		if (!pos.has_value())
+			continue;
+
+		place(mPages[i], segment, pos.value(), width, height);
+		mPages[i].images_count += 1;
+		image.page = i;
+		upload(image, pos.value());
+		return true;
+	}
+
+	return false;
+}
+
+TextureAtlas::Page TextureAtlas::makePage() const
+{
+	auto page = Page();
+	page.texture = std::make_shared<skygfx::Texture>(mPageSize, mPageSize, skygfx::PixelFormat::RGBA8UNorm);
+	page.skyline.push_back({ 0, 0, mPageSize });
+	return page;
+}
+
+void TextureAtlas::addPage()
+{
+	mPages.push_back(makePage());
+}
+
+void TextureAtlas::upload(const Image& image, glm::uvec2 pos)
+{
+	auto width = image.width + Padding * 2;
+	auto height = image.height + Padding * 2;
+	auto pixels = std::vector<uint8_t>((size_t)width * height * 4);
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		auto src_y = std::clamp<int64_t>((int64_t)y - Padding, 0, image.height - 1);
+
+		for (uint32_t x = 0; x < width; x++)
+		{
+			auto src_x = std::clamp<int64_t>((int64_t)x - Padding, 0, image.width - 1);
+			auto src = image.pixels.data() + (src_y * image.width + src_x) * 4;
+			std::copy_n(src, 4, pixels.data() + ((size_t)y * width + x) * 4);
+		}
+	}
+
+	const auto& page = mPages.at(image.page);
+	page.texture->write(width, height, skygfx::PixelFormat::RGBA8UNorm, pixels.data(), 0, pos.x, pos.y);
+
+	auto size = (float)mPageSize;
+	auto& region = *image.region;
+	region.texture = page.texture;
+	region.tex_region.pos = { (float)(pos.x + Padding), (float)(pos.y + Padding) };
+	region.tex_region.size = { (float)image.width, (float)image.height };
+	region.uv = { region.tex_region.pos.x / size, region.tex_region.pos.y / size, image.width / size, image.height / size };
+}
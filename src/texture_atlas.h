@@ -0,0 +1,82 @@
+#pragma once
+
+#include <sky/sky.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace skyapp
+{
+	// packs small images into shared pages, so sprites of many fetched images are drawn without
+	// texture switches. Pages are filled by skyline packer, removed images leave holes that are
+	// reclaimed by repacking, so pixels of images are kept on cpu. Regions are updated in place
+	// when repacked, sprites keep old pages alive until they take the region again
+
+	class TextureAtlas
+	{
+	public:
+		struct Region
+		{
+			std::shared_ptr<skygfx::Texture> texture;
+			Graphics::TexRegion tex_region; // in pixels
+			glm::vec4 uv; // x, y, w, h normalized, for texcoords of gfx vertices
+		};
+
+	public:
+		TextureAtlas(uint32_t page_size = 2048, uint32_t max_image_size = 256);
+
+	public:
+		// rgba image, null when it is larger than max image size
+		std::shared_ptr<Region> insert(const std::string& key, const Graphics::Image& image);
+		std::shared_ptr<Region> find(const std::string& key) const;
+		void remove(const std::string& key);
+		void repack();
+
+		auto getPagesCount() const { return mPages.size(); }
+		auto getImagesCount() const { return mImages.size(); }
+		size_t getBytes() const; // of pages that have texture
+
+		// whole texture as region, for images that do not go to atlas
+		static std::shared_ptr<Region> MakeRegion(std::shared_ptr<skygfx::Texture> texture);
+
+	private:
+		struct Segment
+		{
+			uint32_t x;
+			uint32_t y;
+			uint32_t width;
+		};
+
+		struct Page
+		{
+			std::shared_ptr<skygfx::Texture> texture; // null for emptied page, created when it is used again
+			std::vector<Segment> skyline;
+			size_t images_count = 0;
+			size_t freed_area = 0; // of removed images, reclaimed by repack
+		};
+
+		struct Image
+		{
+			uint32_t width;
+			uint32_t height;
+			std::vector<uint8_t> pixels; // rgba
+			size_t page;
+			std::shared_ptr<Region> region;
+		};
+
+		std::optional<glm::uvec2> findPosition(const Page& page, uint32_t width, uint32_t height, size_t& segment) const;
+		void place(Page& page, size_t segment, glm::uvec2 pos, uint32_t width, uint32_t height);
+		bool tryPlace(Image& image);
+		Page makePage() const;
+		void addPage();
+		void upload(const Image& image, glm::uvec2 pos);
+
+	private:
+		uint32_t mPageSize;
+		uint32_t mMaxImageSize;
+		std::vector<Page> mPages;
+		std::unordered_map<std::string, Image> mImages;
+	};
+}
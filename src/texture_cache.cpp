@@ -0,0 +1,164 @@
+#include "texture_cache.h"
+#include <algorithm>
+
+using namespace skyapp;
+
+TextureCache::TextureCache(TextureAtlas& atlas, size_t budget, size_t encoded_budget) :
+	mAtlas(atlas), mBudget(budget), mEncodedBudget(encoded_budget)
+{
+}
+
+std::shared_ptr<TextureCache::Region> TextureCache::find(const std::string& key)
+{
+	auto it = mEntries.find(key);
+
+	if (it == mEntries.end())
+		return nullptr;
+
+	it->second.last_used = ++mClock;
+	return it->second.region;
+}
+
+std::shared_ptr<TextureCache::Region> TextureCache::insert(const std::string& key, const Graphics::Image& image,
+	const std::vector<Graphics::Image>& mips, bool atlas)
+{
+	if (auto region = find(key))
+		return region;
+
+	auto region = atlas && mips.empty() ? mAtlas.insert(key, image) : nullptr;
+	auto in_atlas = region != nullptr;
+	auto bytes = (size_t)image.getWidth() * image.getHeight() * 4;
+
+	// decoded images are rgba, see TextureLoader
+	if (!in_atlas)
+	{
+		region = TextureAtlas::MakeRegion(MakeTexture(image, mips));
+
+		for (const auto& mip : mips)
+			bytes += (size_t)mip.getWidth() * mip.getHeight() * 4;
+	}
+
+	mEntries.insert({ key, { region, bytes, in_atlas, ++mClock } });
+
+	if (!in_atlas)
+		mBytes += bytes;
+
+	trim(); // new region is held here, so it is not evicted
+	return region;
+}
+
+const std::vector<uint8_t>* TextureCache::findEncoded(const std::string& url)
+{
+	auto it = mEncoded.find(url);
+
+	if (it == mEncoded.end())
+		return nullptr;
+
+	it->second.last_used = ++mClock;
+	return &it->second.data;
+}
+
+void TextureCache::insertEncoded(const std::string& url, const void* memory, size_t size)
+{
+	if (mEncoded.contains(url))
+		return;
+
+	auto bytes = static_cast<const uint8_t*>(memory);
+	mEncoded.insert({ url, { std::vector<uint8_t>(bytes, bytes + size), ++mClock } });
+	mEncodedBytes += size;
+	trimEncoded();
+}
+
+size_t TextureCache::getBytes() const
+{
+	return mBytes + mAtlas.getBytes();
+}
+
+void TextureCache::trim()
+{
+	if (getBytes() <= mBudget)
+		return;
+
+	auto candidates = std::vector<decltype(mEntries)::iterator>();
+
+	for (auto it = mEntries.begin(); it != mEntries.end(); ++it)
+	{
+		if (!IsPinned(it->second))
+			candidates.push_back(it);
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) {
+		return a->second.last_used < b->second.last_used;
+	});
+
+	// atlas pages shrink only when repacked, so their evicted images are counted as freed until then
+	auto atlas_freed = size_t(0);
+
+	for (auto it : candidates)
+	{
+		if (getBytes() <= mBudget + atlas_freed)
+			break;
+
+		if (it->second.atlas)
+		{
+			mAtlas.remove(it->first);
+			atlas_freed += it->second.bytes;
+		}
+		else
+		{
+			mBytes -= it->second.bytes;
+		}
+
+		mEntries.erase(it);
+	}
+
+	if (atlas_freed > 0)
+		mAtlas.repack();
+}
+
+void TextureCache::setBudget(size_t value)
+{
+	mBudget = value;
+	trim();
+}
+
+std::shared_ptr<skygfx::Texture> TextureCache::MakeTexture(const Graphics::Image& image, const std::vector<Graphics::Image>& mips)
+{
+	auto format = skygfx::PixelFormat::RGBA8UNorm;
+	auto width = (uint32_t)image.getWidth();
+	auto height = (uint32_t)image.getHeight();
+	auto texture = std::make_shared<skygfx::Texture>(width, height, format, (uint32_t)mips.size() + 1);
+	texture->write(width, height, format, image.getMemory());
+
+	for (size_t i = 0; i < mips.size(); i++)
+	{
+		texture->write((uint32_t)mips[i].getWidth(), (uint32_t)mips[i].getHeight(), format, mips[i].getMemory(),
+			(uint32_t)i + 1);
+	}
+
+	return texture;
+}
+
+// cache holds region, atlas holds it too, whole texture is held by its region only.
+// Sprites hold regions they show, see SetSpriteRegion
+
+bool TextureCache::IsPinned(const Entry& entry)
+{
+	if (entry.atlas)
+		return entry.region.use_count() > 2;
+
+	return entry.region.use_count() > 1 || entry.region->texture.use_count() > 1;
+}
+
+void TextureCache::trimEncoded()
+{
+	while (mEncodedBytes > mEncodedBudget && !mEncoded.empty())
+	{
+		auto oldest = std::min_element(mEncoded.begin(), mEncoded.end(), [](const auto& a, const auto& b) {
+			return a.second.last_used < b.second.last_used;
+		});
+
+		mEncodedBytes -= oldest->second.data.size();
+		mEncoded.erase(oldest);
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <unordered_map>
+#include "texture_atlas.h"
+
+namespace skyapp
+{
+	// fetched textures with memory budget, atlas pages count against it. Texture is pinned while anything
+	// besides cache and atlas holds it or its region, unpinned ones are evicted least recently used first
+	// when budget is exceeded, atlas is repacked after its images are evicted.
+	// Encoded bytes have own budget and are kept longer, so evicted texture is decoded again without download
+
+	class TextureCache
+	{
+	public:
+		using Region = TextureAtlas::Region;
+
+	public:
+		TextureCache(TextureAtlas& atlas, size_t budget = 256 * 1024 * 1024, size_t encoded_budget = 64 * 1024 * 1024);
+
+	public:
+		std::shared_ptr<Region> find(const std::string& key);
+
+		// image goes to atlas when allowed, small enough and without mips, returns existing region for known key
+		std::shared_ptr<Region> insert(const std::string& key, const Graphics::Image& image,
+			const std::vector<Graphics::Image>& mips, bool atlas);
+
+		const std::vector<uint8_t>* findEncoded(const std::string& url);
+		void insertEncoded(const std::string& url, const void* memory, size_t size);
+
+		void trim();
+
+		auto getBudget() const { return mBudget; }
+		void setBudget(size_t value);
+		size_t getBytes() const; // whole textures and atlas pages
+		auto getEncodedBytes() const { return mEncodedBytes; }
+		auto getEntriesCount() const { return mEntries.size(); }
+
+		// rgba image with optional mip levels
+		static std::shared_ptr<skygfx::Texture> MakeTexture(const Graphics::Image& image, const std::vector<Graphics::Image>& mips);
+
+	private:
+		struct Entry
+		{
+			std::shared_ptr<Region> region;
+			size_t bytes;
+			bool atlas;
+			uint64_t last_used;
+		};
+
+		struct Encoded
+		{
+			std::vector<uint8_t> data;
+			uint64_t last_used;
+		};
+
+		static bool IsPinned(const Entry& entry);
+		void trimEncoded();
+
+	private:
+		TextureAtlas& mAtlas;
+		size_t mBudget;
+		size_t mEncodedBudget;
+		std::unordered_map<std::string, Entry> mEntries;
+		std::unordered_map<std::string, Encoded> mEncoded;
+		size_t mBytes = 0; // of whole textures, atlas pages are counted by atlas
+		size_t mEncodedBytes = 0;
+		uint64_t mClock = 0;
+	};
+}
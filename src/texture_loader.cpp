@@ -0,0 +1,208 @@
+#include "texture_loader.h"
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+using namespace skyapp;
+
+static Graphics::Image ConvertToRGBA(const Graphics::Image& image)
+{
+	auto result = Graphics::Image(image.getWidth(), image.getHeight(), 4);
+	auto channels = (size_t)image.getChannels();
+	auto src = static_cast<const uint8_t*>(image.getMemory());
+	auto dst = static_cast<uint8_t*>(result.getMemory());
+
+	for (size_t i = 0; i < (size_t)image.getWidth() * image.getHeight(); i++)
+	{
+		auto pixel = src + i * channels;
+		dst[i * 4 + 0] = pixel[0];
+		dst[i * 4 + 1] = channels >= 3 ? pixel[1] : pixel[0];
+		dst[i * 4 + 2] = channels >= 3 ? pixel[2] : pixel[0];
+		dst[i * 4 + 3] = channels == 4 ? pixel[3] : channels == 2 ? pixel[1] : 255;
+	}
+
+	return result;
+}
+
+// 2x2 box average, last row and column of odd sizes are repeated
+
+static Graphics::Image Halve(const Graphics::Image& image)
+{
+	auto src_width = image.getWidth();
+	auto src_height = image.getHeight();
+	auto width = std::max(1, src_width / 2);
+	auto height = std::max(1, src_height / 2);
+	auto result = Graphics::Image(width, height, 4);
+	auto src = static_cast<const uint8_t*>(image.getMemory());
+	auto dst = static_cast<uint8_t*>(result.getMemory());
+
+	for (int y = 0; y < height; y++)
+	{
+		auto row0 = src + (size_t)std::min(y * 2, src_height - 1) * src_width * 4;
+		auto row1 = src + (size_t)std::min(y * 2 + 1, src_height - 1) * src_width * 4;
+
+		for (int x = 0; x < width; x++)
+		{
+			auto x0 = (size_t)std::min(x * 2, src_width - 1) * 4;
+			auto x1 = (size_t)std::min(x * 2 + 1, src_width - 1) * 4;
+
+			for (size_t c = 0; c < 4; c++)
+				*dst++ = (uint8_t)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+		}
+	}
+
+	return result;
+}
+
+// bilinear, used only for last step of downscale, so no source pixel is skipped
+
+static Graphics::Image Resize(const Graphics::Image& image, int width, int height)
+{
+	auto src_width = image.getWidth();
+	auto src_height = image.getHeight();
+	auto result = Graphics::Image(width, height, 4);
+	auto src = static_cast<const uint8_t*>(image.getMemory());
+	auto dst = static_cast<uint8_t*>(result.getMemory());
+
+	for (int y = 0; y < height; y++)
+	{
+		auto fy = std::clamp((y + 0.5f) * src_height / height - 0.5f, 0.0f, (float)(src_height - 1));
+		auto y0 = (int)fy;
+		auto y1 = std::min(y0 + 1, src_height - 1);
+		auto ty = fy - y0;
+
+		for (int x = 0; x < width; x++)
+		{
+			auto fx = std::clamp((x + 0.5f) * src_width / width - 0.5f, 0.0f, (float)(src_width - 1));
+			auto x0 = (int)fx;
+			auto x1 = std::min(x0 + 1, src_width - 1);
+			auto tx = fx - x0;
+
+			for (size_t c = 0; c < 4; c++)
+			{
+				auto p00 = src[((size_t)y0 * src_width + x0) * 4 + c];
+				auto p01 = src[((size_t)y0 * src_width + x1) * 4 + c];
+				auto p10 = src[((size_t)y1 * src_width + x0) * 4 + c];
+				auto p11 = src[((size_t)y1 * src_width + x1) * 4 + c];
+				auto top = p00 + (p01 - p00) * tx;
+				auto bottom = p10 + (p11 - p10) * tx;
+				*dst++ = (uint8_t)(top + (bottom - top) * ty + 0.5f);
+			}
+		}
+	}
+
+	return result;
+}
+
+static Graphics::Image Downscale(Graphics::Image image, uint32_t max_size)
+{
+	auto largest = [&] { return (uint32_t)std::max(image.getWidth(), image.getHeight()); };
+
+	while (largest() / 2 >= max_size)
+	{
+		image = Halve(image);
+	}
+
+	if (largest() <= max_size)
+		return image;
+
+	auto scale = (float)max_size / largest();
+	auto width = std::max(1, (int)std::round(image.getWidth() * scale));
+	auto height = std::max(1, (int)std::round(image.getHeight() * scale));
+	return Resize(image, width, height);
+}
+
+static std::vector<Graphics::Image> MakeMips(const Graphics::Image& image)
+{
+	auto mips = std::vector<Graphics::Image>();
+
+	while (true)
+	{
+		const auto& level = mips.empty() ? image : mips.back();
+
+		if (level.getWidth() <= 1 && level.getHeight() <= 1)
+			break;
+
+		auto next = Halve(level);
+		mips.push_back(std::move(next));
+	}
+
+	return mips;
+}
+
+TextureLoader::TextureLoader(ThreadPool& pool) : mPool(pool)
+{
+}
+
+void TextureLoader::decode(const void* memory, size_t size, Options options, Callback callback,
+	FailedCallback failedCallback)
+{
+	auto id = mNextId++;
+	auto bytes = static_cast<const uint8_t*>(memory);
+	mCallbacks.insert({ id, { std::move(callback), std::move(failedCallback) } });
+
+	mPool.execute([queue = mQueue, id, options, encoded = std::vector<uint8_t>(bytes, bytes + size)] {
+		auto decoded = Decoded{ id };
+		auto image = Graphics::Image((void*)encoded.data(), encoded.size());
+
+		if (image.getWidth() > 0 && image.getHeight() > 0)
+		{
+			if (image.getChannels() != 4)
+				image = ConvertToRGBA(image);
+
+			if (options.max_size.has_value())
+				image = Downscale(std::move(image), std::max(options.max_size.value(), 1u));
+
+			auto mips = options.mipmaps ? MakeMips(image) : std::vector<Graphics::Image>();
+			decoded.result.emplace(Result{ std::move(image), std::move(mips) });
+		}
+
+		std::unique_lock lock(queue->mutex);
+		queue->items.push_back(std::move(decoded));
+	});
+}
+
+void TextureLoader::update()
+{
+	{
+		std::unique_lock lock(mQueue->mutex);
+		std::move(mQueue->items.begin(), mQueue->items.end(), std::back_inserter(mReady));
+		mQueue->items.clear();
+	}
+
+	auto handed = size_t(0);
+
+	while (!mReady.empty())
+	{
+		auto bytes = size_t(0);
+
+		if (const auto& result = mReady.front().result; result.has_value())
+		{
+			bytes = (size_t)result->image.getWidth() * result->image.getHeight() * 4;
+
+			for (const auto& mip : result->mips)
+				bytes += (size_t)mip.getWidth() * mip.getHeight() * 4;
+		}
+
+		if (handed > 0 && handed + bytes > mUploadBudget)
+			break;
+
+		auto decoded = std::move(mReady.front());
+		mReady.pop_front();
+
+		// extracted first, callback may start new decoding
+		auto node = mCallbacks.extract(decoded.id);
+
+		if (node.empty())
+			continue;
+
+		auto& [callback, failed_callback] = node.mapped();
+
+		if (decoded.result.has_value())
+			callback(decoded.result.value());
+		else if (failed_callback)
+			failed_callback();
+
+		handed += bytes;
+	}
+}
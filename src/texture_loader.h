@@ -0,0 +1,70 @@
+#pragma once
+
+#include <sky/sky.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "thread_pool.h"
+
+namespace skyapp
+{
+	// decodes fetched images on thread pool, decoded images are handed to main thread for upload
+	// within per frame budget of bytes, so burst of arrived images is spread over several frames
+
+	class TextureLoader
+	{
+	public:
+		struct Options
+		{
+			std::optional<uint32_t> max_size; // larger images are downscaled to fit, keeping aspect
+			bool mipmaps = false;
+		};
+
+		struct Result
+		{
+			Graphics::Image image; // rgba
+			std::vector<Graphics::Image> mips; // from half size down to 1x1, when requested
+		};
+
+		using Callback = std::function<void(const Result& result)>;
+		using FailedCallback = std::function<void()>;
+
+	public:
+		TextureLoader(ThreadPool& pool);
+
+	public:
+		// encoded png or jpeg, memory is copied. Callbacks are called on main thread from update
+		void decode(const void* memory, size_t size, Options options, Callback callback,
+			FailedCallback failedCallback = nullptr);
+		void update();
+
+		auto getUploadBudget() const { return mUploadBudget; }
+		void setUploadBudget(size_t value) { mUploadBudget = value; }
+		auto getPendingCount() const { return mCallbacks.size(); }
+
+	private:
+		struct Decoded
+		{
+			uint64_t id;
+			std::optional<Result> result;
+		};
+
+		struct Queue
+		{
+			std::mutex mutex;
+			std::deque<Decoded> items;
+		};
+
+	private:
+		ThreadPool& mPool;
+		std::shared_ptr<Queue> mQueue = std::make_shared<Queue>(); // shared with tasks that may outlive loader
+		std::unordered_map<uint64_t, std::pair<Callback, FailedCallback>> mCallbacks; // stay on main thread, they may hold lua references
+		std::deque<Decoded> mReady; // waiting for upload budget
+		uint64_t mNextId = 0;
+		size_t mUploadBudget = 4 * 1024 * 1024; // bytes per frame, at least one image is handed each frame
+	};
+}
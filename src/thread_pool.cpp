@@ -0,0 +1,96 @@
+#include "thread_pool.h"
+
+using namespace skyapp;
+
+ThreadPool::ThreadPool(size_t threads_count)
+{
+	if (!HasThreads())
+		return;
+
+	for (size_t i = 0; i < threads_count; i++)
+	{
+		mThreads.emplace_back([this] {
+			threadLoop();
+		});
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock lock(mMutex);
+		mStopping = true;
+	}
+
+	mCondition.notify_all();
+
+	for (auto& thread : mThreads)
+	{
+		thread.join();
+	}
+}
+
+void ThreadPool::execute(Task task)
+{
+	{
+		std::unique_lock lock(mMutex);
+		mTasks.push_back(std::move(task));
+	}
+
+	mCondition.notify_one();
+}
+
+void ThreadPool::poll()
+{
+	if (HasThreads())
+		return;
+
+	auto tasks = std::deque<Task>();
+
+	{
+		std::unique_lock lock(mMutex);
+		std::swap(tasks, mTasks);
+	}
+
+	for (const auto& task : tasks)
+	{
+		task();
+	}
+}
+
+bool ThreadPool::HasThreads()
+{
+#if defined(EMSCRIPTEN) && !defined(__EMSCRIPTEN_PTHREADS__)
+	return false;
+#else
+	return true;
+#endif
+}
+
+size_t ThreadPool::DefaultThreadsCount()
+{
+	// leave one core for main thread
+	auto cores = std::thread::hardware_concurrency();
+	return cores > 1 ? cores - 1 : 1;
+}
+
+void ThreadPool::threadLoop()
+{
+	while (true)
+	{
+		auto task = Task();
+
+		{
+			std::unique_lock lock(mMutex);
+			mCondition.wait(lock, [this] { return mStopping || !mTasks.empty(); });
+
+			if (mStopping && mTasks.empty())
+				return;
+
+			task = std::move(mTasks.front());
+			mTasks.pop_front();
+		}
+
+		task();
+	}
+}
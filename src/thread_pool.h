@@ -0,0 +1,43 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace skyapp
+{
+	// fixed set of background threads, on platforms without threads tasks
+	// are queued and executed on main thread inside poll()
+
+	class ThreadPool
+	{
+	public:
+		using Task = std::function<void()>;
+
+	public:
+		ThreadPool(size_t threads_count = DefaultThreadsCount());
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+		~ThreadPool();
+
+	public:
+		void execute(Task task);
+		void poll();
+
+		static bool HasThreads();
+
+	private:
+		static size_t DefaultThreadsCount();
+		void threadLoop();
+
+	private:
+		std::vector<std::thread> mThreads;
+		std::mutex mMutex;
+		std::condition_variable mCondition;
+		std::deque<Task> mTasks;
+		bool mStopping = false;
+	};
+}
@@ -0,0 +1,129 @@
+#include "utf8.h"
+
+using namespace skyapp;
+
+static constexpr char32_t ReplacementChar = 0xFFFD;
+
+static char32_t DecodeUtf8(std::string_view str, size_t& pos)
+{
+	auto lead = (unsigned char)str[pos++];
+
+	if (lead < 0x80)
+		return lead;
+
+	int extra = 0;
+	char32_t result = 0;
+	char32_t min = 0;
+
+	if ((lead & 0xE0) == 0xC0) { extra = 1; result = lead & 0x1F; min = 0x80; }
+	else if ((lead & 0xF0) == 0xE0) { extra = 2; result = lead & 0x0F; min = 0x800; }
+	else if ((lead & 0xF8) == 0xF0) { extra = 3; result = lead & 0x07; min = 0x10000; }
+	else
+		return ReplacementChar;
+
+	for (int i = 0; i < extra; i++)
+	{
+		if (pos >= str.size() || ((unsigned char)str[pos] & 0xC0) != 0x80)
+			return ReplacementChar;
+
+		result = (result << 6) | ((unsigned char)str[pos++] & 0x3F);
+	}
+
+	if (result < min || result > 0x10FFFF || (result >= 0xD800 && result <= 0xDFFF))
+		return ReplacementChar;
+
+	return result;
+}
+
+static char32_t DecodeWide(std::wstring_view str, size_t& pos)
+{
+	char32_t c = (char32_t)str[pos++];
+
+	if constexpr (sizeof(wchar_t) == 2)
+	{
+		if (c >= 0xD800 && c <= 0xDBFF && pos < str.size())
+		{
+			char32_t low = (char32_t)str[pos];
+			if (low >= 0xDC00 && low <= 0xDFFF)
+			{
+				pos++;
+				return 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+			}
+		}
+	}
+
+	if ((c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF)
+		return ReplacementChar;
+
+	return c;
+}
+
+bool skyapp::EqualsUtf8(std::wstring_view wide, std::string_view utf8)
+{
+	size_t wide_pos = 0;
+	size_t utf8_pos = 0;
+
+	while (wide_pos < wide.size() && utf8_pos < utf8.size())
+	{
+		if (DecodeWide(wide, wide_pos) != DecodeUtf8(utf8, utf8_pos))
+			return false;
+	}
+
+	return wide_pos == wide.size() && utf8_pos == utf8.size();
+}
+
+void skyapp::Utf8ToWide(std::string_view utf8, std::wstring& out)
+{
+	out.clear();
+
+	size_t pos = 0;
+	while (pos < utf8.size())
+	{
+		auto c = DecodeUtf8(utf8, pos);
+
+		if (sizeof(wchar_t) == 2 && c >= 0x10000)
+		{
+			c -= 0x10000;
+			out.push_back((wchar_t)(0xD800 + (c >> 10)));
+			out.push_back((wchar_t)(0xDC00 + (c & 0x3FF)));
+		}
+		else
+		{
+			out.push_back((wchar_t)c);
+		}
+	}
+}
+
+void skyapp::WideToUtf8(std::wstring_view wide, std::string& out)
+{
+	out.clear();
+
+	size_t pos = 0;
+	while (pos < wide.size())
+	{
+		auto c = DecodeWide(wide, pos);
+
+		if (c < 0x80)
+		{
+			out.push_back((char)c);
+		}
+		else if (c < 0x800)
+		{
+			out.push_back((char)(0xC0 | (c >> 6)));
+			out.push_back((char)(0x80 | (c & 0x3F)));
+		}
+		else if (c < 0x10000)
+		{
+			out.push_back((char)(0xE0 | (c >> 12)));
+			out.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+			out.push_back((char)(0x80 | (c & 0x3F)));
+		}
+		else
+		{
+			out.push_back((char)(0xF0 | (c >> 18)));
+			out.push_back((char)(0x80 | ((c >> 12) & 0x3F)));
+			out.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+			out.push_back((char)(0x80 | (c & 0x3F)));
+		}
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace skyapp
+{
+	// conversions between lua utf-8 strings and engine wide strings, writing into
+	// caller's buffers so repeated updates reuse their capacity.
+	// wchar_t is utf-16 on windows and utf-32 elsewhere, invalid bytes become U+FFFD
+
+	bool EqualsUtf8(std::wstring_view wide, std::string_view utf8);
+	void Utf8ToWide(std::string_view utf8, std::wstring& out);
+	void WideToUtf8(std::wstring_view wide, std::string& out);
+}